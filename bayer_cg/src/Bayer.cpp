@@ -20,7 +20,12 @@
 #include <Cg/cgGL.h>
 #include "Image.hpp"
 #include "BayerRenderer.hpp"
+#include "FrameCache.hpp"
 #include "GLUTFPSCounter.hpp"
+#ifdef HEADLESS
+# include "OffscreenContext.hpp"
+#endif
+#include "QualityController.hpp"
 #include "trackball.h"
 
 // Frames per second counter.
@@ -33,6 +38,10 @@ CGcontext context;
 CGprofile vertexProfile, fragmentProfile;
 CGprogram vertexProgram, fragmentProgram;
 
+// Handles to their parameters, looked up once by load_cg_programs.
+static CGparameter modelViewProjParam, decalParam;
+static CGparameter brightnessParam, contrastParam, grayscaleParam;
+
 // Window dimensions.
 static int w;
 static int h;
@@ -46,6 +55,29 @@ static float brightness = 1.0;
 static float contrast = 1.0;
 static bool grayscale = false;
 
+// Frame period of the image stream, in seconds.
+static const float NTSC_FRAMERATE = 1.0/29.97;
+
+// Demosaicing quality, stepped down when frames take longer than the
+// frame period and back up when there is headroom again.
+static QualityController quality (BayerRenderer::QUALITY_LEVELS, NTSC_FRAMERATE);
+static bool adapt_quality = true;
+
+// Demosaic only the part of the image the viewport shows, and at half
+// resolution when the view shrinks it that far.
+static bool lazy = false;
+
+// Demosaic and adjust in one pass straight to the window when the image
+// is shown unrotated at one texel per pixel.  Saved frames are read
+// from the render target, which that pass skips, and so are cached
+// frames: the pass is on by default only without a cache, and when
+// turned on with one, frames it draws are not cached.
+#ifdef SAVEFRAMES
+static const bool single_pass = false;
+#else
+static bool single_pass = false;
+#endif
+
 // Pointer to bayer images.
 #define STREAM
 #ifdef STREAM
@@ -54,6 +86,14 @@ static GLubyte **data = NULL;
 static GLubyte *data = NULL;
 #endif
 
+// Hashes of the bayer images, computed as they are loaded.
+static unsigned long long *hashes = NULL;
+
+// Demosaiced frames, reused when a frame is shown again at the same
+// quality, or NULL if caching is disabled.
+static const int CACHE_FRAMES = 16;
+static FrameCache *cache = NULL;
+
 static int start_time;
 static int end_time;
 static int num_frames = 0;
@@ -71,6 +111,14 @@ static void handleCgError ();
 static void load_cg_programs ();
 static void load_profiles ();
 static void read_images (const char *prefix, int num_frames);
+static bool visible_rect (GLdouble p, GLdouble zcenter, BayerRenderer::Rect &rect, double &texels);
+static bool one_to_one ();
+#ifdef SAVEFRAMES
+static void save_frame (const GLubyte *rgb, int frame, void *data);
+#endif
+#ifdef HEADLESS
+static int run_headless (int passes);
+#endif
 
 int
 main (int   argc,
@@ -78,8 +126,24 @@ main (int   argc,
 {
 	const int LEN = 20;
 	char prefix[LEN];
+	int cache_frames = CACHE_FRAMES;
+#ifdef HEADLESS
+	// -b <passes>: time each quality level over the frames without a
+	// window, then exit.
+	int passes = 0;
+	if (argc > 3 && strcmp (argv[1], "-b") == 0) {
+		passes = strtol (argv[2], NULL, 10);
+		argc -= 2;
+		argv += 2;
+	}
+#endif
 	if (argc < 2) {
-		std::cerr << "USAGE: " << argv[0] << " <prefix> <num_frames>" << std::endl;
+#ifdef HEADLESS
+		std::cerr << "USAGE: " << argv[0] << " [-b <passes>] <prefix> <num_frames> [<cache_frames>]" << std::endl;
+#else
+		std::cerr << "USAGE: " << argv[0] << " <prefix> <num_frames> [<cache_frames>]" << std::endl;
+#endif
+		std::cerr << "  cache_frames defaults to " << CACHE_FRAMES << "; 0 draws 1:1 frames in a single pass" << std::endl;
 		exit (EXIT_FAILURE);
 	}
 	snprintf (prefix, LEN, "%s", argv[1]);
@@ -88,6 +152,9 @@ main (int   argc,
 	if (argc > 2) {
 		num_frames = strtol (argv[2], NULL, 10);
 		read_images (prefix, num_frames);
+		if (argc > 3) {
+			cache_frames = strtol (argv[3], NULL, 10);
+		}
 	} else {
 		num_frames = 1;
 		data = new GLubyte*[1];
@@ -95,9 +162,16 @@ main (int   argc,
 			std::cerr << "ERROR: cannot open file '" << argv[1] << "'." << std::endl;
 			exit (EXIT_FAILURE);
 		}
+		hashes = new unsigned long long[1];
+		hashes[0] = FrameCache::hash (data[0], texw * texh);
 	}
 	w = texw;
 	h = texh;
+#ifdef HEADLESS
+	if (passes > 0) {
+		return run_headless (passes);
+	}
+#endif
 	
 	glutInit (&argc, argv);
 	glutInitDisplayMode (GLUT_DOUBLE | GLUT_RGB);
@@ -133,6 +207,15 @@ main (int   argc,
 	}
 	br->Bind ();
 	glTexEnvf (GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+#ifdef SAVEFRAMES
+	br->SetReadback (save_frame, NULL);
+#endif
+	if (cache_frames > 0) {
+		cache = new FrameCache (cache_frames, texw, texh);
+	}
+#ifndef SAVEFRAMES
+	single_pass = (cache == NULL);
+#endif
 	tbInit (GLUT_LEFT_BUTTON);
 	tbAnimate (true);
 	fps_counter.start ();
@@ -161,6 +244,18 @@ display ()
 	static int increment = 1;
 
 	bool display_fps = fps_counter.update ();
+
+	// Choose the demosaicing quality from the time the last frame took.
+	static double last_frame = 0.0;
+	double now = QualityController::now ();
+	if (adapt_quality) {
+		if (last_frame > 0.0) {
+			quality.update (now - last_frame);
+		}
+		br->SetQuality (static_cast<BayerRenderer::Quality>(quality.get_level ()));
+	}
+	last_frame = now;
+
 	glClear (GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 	glMatrixMode (GL_PROJECTION);
 	glLoadIdentity ();
@@ -171,62 +266,100 @@ display ()
 	tbMatrix ();		// trackball rotation
 	glTranslatef (0.0, 0.0, -zcenter); // translate so rotation is around zcenter
 	
-	// Bind the vertex and fragment programs.
-	cgGLBindProgram (vertexProgram);
-	cgGLEnableProfile (vertexProfile);
-	cgGLBindProgram (fragmentProgram);
-	cgGLEnableProfile (fragmentProfile);
-
-	// Bind uniform parameters to the vertex shader.
-	cgGLSetStateMatrixParameter(cgGetNamedParameter(vertexProgram, "ModelViewProj"),
-				    CG_GL_MODELVIEW_PROJECTION_MATRIX,
-				    CG_GL_MATRIX_IDENTITY);
-
-	// Bind uniform parameters to the fragment shader.
-	cgGLSetParameter1f (cgGetNamedParameter (fragmentProgram, "brightness"), brightness);
-	cgGLSetParameter1f (cgGetNamedParameter (fragmentProgram, "contrast"), contrast);
-	cgGLSetParameter1f (cgGetNamedParameter (fragmentProgram, "grayscale"), grayscale);
-
-	// Enable texture for the fragment shader.
-	cgGLEnableTextureParameter (cgGetNamedParameter (fragmentProgram, "decal"));
-
-	// Render Bayer data.
-	br->SetBayer (data[n-1]);
- 	br->Bind ();
-	br->EnableTextureTarget ();
-	glBegin (GL_QUADS);
- 	glTexCoord2i (0, 0);       glVertex3f (p, p, zcenter);
- 	glTexCoord2i (texw, 0);    glVertex3f (-p, p, zcenter);
- 	glTexCoord2i (texw, texh); glVertex3f (-p, -p, zcenter);
- 	glTexCoord2i (0, texh);    glVertex3f (p, -p, zcenter);
-        glEnd();
-	br->DisableTextureTarget ();
-
-	// Disable texture for the fragment shader.
-	cgGLDisableTextureParameter (cgGetNamedParameter (fragmentProgram, "decal"));
-
-	cgGLDisableProfile (vertexProfile);
-	cgGLDisableProfile (fragmentProfile);
+	// In lazy mode, find the visible texels and how many of them fall
+	// on each screen pixel.
+	BayerRenderer::Rect visible;
+	BayerRenderer::Quality chosen = br->GetQuality ();
+	bool partial = false;
+	double texels;
+	if (lazy && visible_rect (p, zcenter, visible, texels)) {
+		partial = (visible.width < texw || visible.height < texh);
+		if (texels >= 2.0) {
+			br->SetQuality (BayerRenderer::QUALITY_SUPERPIXEL);
+		}
+	}
+
+	// Render Bayer data, unless this frame was demosaiced before at
+	// the same quality.  Partly rendered frames are not cached.
+	GLuint cached = 0;
+	if (cache != NULL) {
+		cached = cache->find (hashes[n-1], br->GetQuality ());
+	}
+	bool fused = (single_pass && cached == 0 && !partial && one_to_one ());
+	if (fused) {
+		// Skip the render target and the second pass through imagef.
+		br->DrawBayer (data[n-1], brightness, contrast, grayscale);
+	} else {
+		if (cached == 0) {
+			if (partial) {
+				br->SetBayer (data[n-1], &visible, 1);
+			} else {
+				br->SetBayer (data[n-1]);
+				if (cache != NULL) {
+					br->CopyTo (cache->insert (hashes[n-1], br->GetQuality ()));
+				}
+#ifdef SAVEFRAMES
+				// Save the demosaiced frame, without waiting for it.
+				br->ReadBack (count);
+#endif
+			}
+			br->Bind ();
+		} else {
+			glBindTexture (GL_TEXTURE_RECTANGLE_NV, cached);
+		}
+
+		// Bind the programs after demosaicing, which binds its own
+		// in this context when rendering to a framebuffer object.
+		cgGLBindProgram (vertexProgram);
+		cgGLEnableProfile (vertexProfile);
+		cgGLBindProgram (fragmentProgram);
+		cgGLEnableProfile (fragmentProfile);
+
+		// Bind uniform parameters to the vertex shader.
+		cgGLSetStateMatrixParameter(modelViewProjParam,
+					    CG_GL_MODELVIEW_PROJECTION_MATRIX,
+					    CG_GL_MATRIX_IDENTITY);
+
+		// Bind uniform parameters to the fragment shader.
+		cgGLSetParameter1f (brightnessParam, brightness);
+		cgGLSetParameter1f (contrastParam, contrast);
+		cgGLSetParameter1f (grayscaleParam, grayscale);
+
+		// Enable texture for the fragment shader.
+		cgGLEnableTextureParameter (decalParam);
+
+		br->EnableTextureTarget ();
+		glBegin (GL_QUADS);
+		glTexCoord2i (0, 0);       glVertex3f (p, p, zcenter);
+		glTexCoord2i (texw, 0);    glVertex3f (-p, p, zcenter);
+		glTexCoord2i (texw, texh); glVertex3f (-p, -p, zcenter);
+		glTexCoord2i (0, texh);    glVertex3f (p, -p, zcenter);
+		glEnd();
+		br->DisableTextureTarget ();
+
+		// Disable texture for the fragment shader.
+		cgGLDisableTextureParameter (decalParam);
+
+		cgGLDisableProfile (vertexProfile);
+		cgGLDisableProfile (fragmentProfile);
+	}
+	br->SetQuality (chosen);
 
 	// Display frames per second.
 	if (display_fps) {
-		fprintf (stderr, "FPS: %3.2f\n", fps_counter.get_fps ());
+		fprintf (stderr, "FPS: %3.2f  quality: %d  pattern: %d%s%s%s", fps_counter.get_fps (),
+			 br->GetQuality (), br->GetPattern (), adapt_quality ? " (auto)" : "",
+			 lazy ? " (lazy)" : "", fused ? " (single pass)" : "");
+		if (cache != NULL) {
+			fprintf (stderr, "  cache: %lu hits, %lu misses",
+				 cache->get_hits (), cache->get_misses ());
+		}
+		fprintf (stderr, "\n");
 	}
 
-#ifdef SAVEFRAMES
-	// Save frame to disk.
-	GLubyte *pixelbuffer = new GLubyte[w*h*3];
-	glReadPixels (0, 0, w, h, GL_RGB, GL_UNSIGNED_BYTE, pixelbuffer);
-	char filename[20];
-	sprintf (filename, "%s%05d.png", "out/out", count);
-	write_image (filename, pixelbuffer, w, h);
-	delete [] pixelbuffer;
-	std::cerr<< "readpixels" << std::endl;
-#endif
 	glutSwapBuffers ();
 
 	// Increment frame if enough time has elapsed.
-	static const float NTSC_FRAMERATE = 1.0/29.97;
 	end_time = glutGet (GLUT_ELAPSED_TIME);
 	float elapsed = (end_time - start_time) / 1e3;
 	if (elapsed > NTSC_FRAMERATE) {
@@ -287,6 +420,10 @@ keyboard (unsigned char key,
 	case 27:
 	case 'Q':
 	case 'q':
+#ifdef SAVEFRAMES
+		br->PollReadback (true);
+#endif
+		delete cache;
 		cgDestroyContext (context);
 		exit (EXIT_SUCCESS);
 		break;
@@ -322,12 +459,238 @@ keyboard (unsigned char key,
 	case 'f':
 		glutFullScreen ();
 		break;
+	case 'A':
+	case 'a':
+		adapt_quality = !adapt_quality;
+		if (adapt_quality) {
+			quality.set_level (br->GetQuality ());
+		}
+		break;
+	case 'L':
+	case 'l':
+		lazy = !lazy;
+		break;
+#ifndef SAVEFRAMES
+	case 'P':
+	case 'p':
+		single_pass = !single_pass;
+		break;
+#endif
+	case 'B':
+	case 'b':
+		// Next colour filter layout; cached frames are of the old one.
+		br->SetPattern (static_cast<BayerRenderer::Pattern>((br->GetPattern () + 1) % BayerRenderer::PATTERNS));
+		if (cache != NULL) {
+			cache->clear ();
+		}
+		break;
+	case '1':
+	case '2':
+	case '3':
+		adapt_quality = false;
+		br->SetQuality (static_cast<BayerRenderer::Quality>(key - '1'));
+		break;
 	default:
 		break;
 	}
 	glutPostRedisplay ();
 }
 
+#ifdef SAVEFRAMES
+// Readback callback: saves a demosaiced frame to disk.
+static void
+save_frame (const GLubyte *rgb,
+	    int frame,
+	    void *data)
+{
+	char filename[20];
+	sprintf (filename, "%s%05d.png", "out/out", frame);
+	write_image (filename, rgb, texw, texh);
+}
+#endif
+
+// Finds the texels the viewport shows, for the image quad drawn from
+// (p, p) to (-p, -p) at depth zcenter under the current matrices: the
+// bounding box of the viewport corners unprojected onto the quad's
+// plane, grown past the kernel reach and rounded out to whole tiles.
+// texels is set to the fewest texels along a screen pixel at the
+// viewport edges.  Returns false if a corner sees past the plane, when
+// the whole image may be needed.
+static bool
+visible_rect (GLdouble p,
+	      GLdouble zcenter,
+	      BayerRenderer::Rect &rect,
+	      double &texels)
+{
+	static const int TILE = 64;
+	static const int MARGIN = 8;
+	GLdouble model[16], proj[16];
+	GLint view[4];
+	double u[4], v[4];
+	double umin, umax, vmin, vmax;
+
+	glGetDoublev (GL_MODELVIEW_MATRIX, model);
+	glGetDoublev (GL_PROJECTION_MATRIX, proj);
+	glGetIntegerv (GL_VIEWPORT, view);
+	for (int i = 0; i < 4; i++) {
+		GLdouble sx = view[0] + ((i == 1 || i == 2) ? view[2] : 0);
+		GLdouble sy = view[1] + ((i >= 2) ? view[3] : 0);
+		GLdouble x0, y0, z0, x1, y1, z1, t;
+		gluUnProject (sx, sy, 0.0, model, proj, view, &x0, &y0, &z0);
+		gluUnProject (sx, sy, 1.0, model, proj, view, &x1, &y1, &z1);
+		// The ray through the corner must meet the plane between the
+		// near and far planes.
+		if ((z0 - zcenter) * (z1 - zcenter) > 0.0 || z0 == z1) {
+			return false;
+		}
+		t = (zcenter - z0) / (z1 - z0);
+		u[i] = (x0 + t * (x1 - x0) - p) / (-2.0 * p) * texw;
+		v[i] = (y0 + t * (y1 - y0) - p) / (-2.0 * p) * texh;
+	}
+
+	umin = umax = u[0];
+	vmin = vmax = v[0];
+	texels = -1.0;
+	for (int i = 0; i < 4; i++) {
+		int j = (i + 1) % 4;
+		double d = sqrt ((u[j] - u[i]) * (u[j] - u[i]) + (v[j] - v[i]) * (v[j] - v[i]));
+		d /= (i % 2 == 0) ? view[2] : view[3];
+		if (texels < 0.0 || d < texels) {
+			texels = d;
+		}
+		umin = (u[i] < umin) ? u[i] : umin;
+		umax = (u[i] > umax) ? u[i] : umax;
+		vmin = (v[i] < vmin) ? v[i] : vmin;
+		vmax = (v[i] > vmax) ? v[i] : vmax;
+	}
+
+	int x0 = static_cast<int>(floor ((umin - MARGIN) / TILE)) * TILE;
+	int y0 = static_cast<int>(floor ((vmin - MARGIN) / TILE)) * TILE;
+	int x1 = static_cast<int>(ceil ((umax + MARGIN) / TILE)) * TILE;
+	int y1 = static_cast<int>(ceil ((vmax + MARGIN) / TILE)) * TILE;
+	rect.x = (x0 < 0) ? 0 : (x0 > texw) ? texw : x0;
+	rect.y = (y0 < 0) ? 0 : (y0 > texh) ? texh : y0;
+	rect.width = ((x1 > texw) ? texw : (x1 < rect.x) ? rect.x : x1) - rect.x;
+	rect.height = ((y1 > texh) ? texh : (y1 < rect.y) ? rect.y : y1) - rect.y;
+	return true;
+}
+
+// True if the image quad, drawn under the current matrices, lands on
+// the viewport at one texel per pixel: no trackball rotation and a
+// texw x texh viewport.
+static bool
+one_to_one ()
+{
+	static const GLdouble EPSILON = 1e-6;
+	GLdouble model[16];
+	GLint view[4];
+
+	glGetIntegerv (GL_VIEWPORT, view);
+	if (view[2] != texw || view[3] != texh) {
+		return false;
+	}
+	glGetDoublev (GL_MODELVIEW_MATRIX, model);
+	for (int i = 0; i < 16; i++) {
+		if (!(fabs (model[i] - ((i % 5 == 0) ? 1.0 : 0.0)) < EPSILON)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+#ifdef HEADLESS
+// Demosaics every frame passes times at each quality level in an
+// offscreen context, and prints the frame rates.  Only the demosaicing
+// is timed; nothing is displayed.
+static int
+run_headless (int passes)
+{
+	OffscreenContext offscreen;
+	if (!offscreen.Initialize (w, h)) {
+		std::cerr << "ERROR: unable to create offscreen context" << std::endl;
+		return (EXIT_FAILURE);
+	}
+	std::cerr << "Cg Bayer Renderer (headless)\nUsing " << glGetString (GL_RENDERER) << std::endl;
+
+	cgSetErrorCallback (handleCgError);
+	context = cgCreateContext ();
+	load_profiles ();
+	br = new BayerRenderer ();
+	if (!(br->Initialize (texw, texh, context, vertexProfile, fragmentProfile))) {
+		std::cerr << "ERROR: unable to initialize BayerRenderer" << std::endl;
+		return (EXIT_FAILURE);
+	}
+
+	int frames = 0;
+	for (int n = 0; n < num_frames; n++) {
+		frames += (data[n] != NULL);
+	}
+	for (int q = 0; q < BayerRenderer::QUALITY_LEVELS && frames > 0; q++) {
+		br->SetQuality (static_cast<BayerRenderer::Quality>(q));
+		// The first frame at a level also pays for loading its program.
+		for (int n = 0; n < num_frames; n++) {
+			if (data[n] != NULL) {
+				br->SetBayer (data[n]);
+				break;
+			}
+		}
+		glFinish ();
+		double start = QualityController::now ();
+		for (int i = 0; i < passes; i++) {
+			for (int n = 0; n < num_frames; n++) {
+				if (data[n] != NULL) {
+					br->SetBayer (data[n]);
+				}
+			}
+		}
+		glFinish ();
+		double elapsed = QualityController::now () - start;
+
+		// Again through the upload ring, copying each frame into
+		// mapped memory as a capture driver would write it.
+		double elapsed_mapped = 0.0;
+		start = QualityController::now ();
+		for (int i = 0; i < passes; i++) {
+			for (int n = 0; n < num_frames; n++) {
+				GLubyte *p;
+				if (data[n] != NULL && (p = br->MapBayer ()) != NULL) {
+					memcpy (p, data[n], texw * texh);
+					br->SetMappedBayer ();
+				}
+			}
+		}
+		if (br->FlushMappedBayer ()) {
+			glFinish ();
+			elapsed_mapped = QualityController::now () - start;
+		}
+
+		// Again demosaicing and adjusting in one pass, straight to
+		// the offscreen framebuffer.
+		start = QualityController::now ();
+		for (int i = 0; i < passes; i++) {
+			for (int n = 0; n < num_frames; n++) {
+				if (data[n] != NULL) {
+					br->DrawBayer (data[n], brightness, contrast, grayscale);
+				}
+			}
+		}
+		glFinish ();
+		double elapsed_single = QualityController::now () - start;
+
+		fprintf (stderr, "quality %d: %3.2f FPS", q, passes * frames / elapsed);
+		if (elapsed_mapped > 0.0) {
+			fprintf (stderr, ", %3.2f FPS through the upload ring", passes * frames / elapsed_mapped);
+		}
+		fprintf (stderr, ", %3.2f FPS in a single pass", passes * frames / elapsed_single);
+		fprintf (stderr, "\n");
+	}
+
+	delete br;
+	cgDestroyContext (context);
+	return (EXIT_SUCCESS);
+}
+#endif
+
 // Cg error callback.
 static void
 handleCgError ()
@@ -393,6 +756,12 @@ load_cg_programs ()
 	}
 	// Enable the appropriate vertex profile and load the vertex program.
 	cgGLLoadProgram (fragmentProgram);
+
+	modelViewProjParam = cgGetNamedParameter (vertexProgram, "ModelViewProj");
+	decalParam = cgGetNamedParameter (fragmentProgram, "decal");
+	brightnessParam = cgGetNamedParameter (fragmentProgram, "brightness");
+	contrastParam = cgGetNamedParameter (fragmentProgram, "contrast");
+	grayscaleParam = cgGetNamedParameter (fragmentProgram, "grayscale");
 }
 
 // Reads a stream of images from the disk.
@@ -404,10 +773,14 @@ read_images (const char *prefix,
 	int prefix_len = strlen (prefix);
 	sprintf (filename, "%s", prefix);
 	data = new GLubyte*[num_frames];
+	hashes = new unsigned long long[num_frames];
 	for (int i = 1; i <= num_frames; i++) {
 		sprintf (filename+prefix_len, "%08d.png.png", i);
 		if ((data[i-1] = read_image (filename, texw, texh)) == NULL) {
 			std::cerr << "ERROR: cannot open file '" << filename << "'." << std::endl;
+			hashes[i-1] = 0;
+		} else {
+			hashes[i-1] = FrameCache::hash (data[i-1], texw * texh);
 		}
 		std::cerr << filename << std::endl;
 	}
@@ -1,19 +1,66 @@
 #include <iostream>
-#include "RenderTexture.h"
 #include "BayerRenderer.hpp"
 
 const char *BayerRenderer::RENDERTEXTURE_INIT = "rgb texRECT";
 
-const GLfloat BayerRenderer::MASK[] =
+const GLfloat BayerRenderer::SHADING_RANGE = 4.0;
+
+const int BayerRenderer::HALO = 2;
+
+const char *BayerRenderer::FRAGMENT_PROGRAMS[] =
 {
-	// G1 B R G2
-	0, 1.0, 0, 0,  0, 0, 1.0, 0,
-	1.0, 0, 0, 0,  0, 0, 0, 1.0
+	"bayerhqf.cg",
+#ifdef BAYER
+	"bayerrawf.cg",
+#elif (defined(OLD))
+	"bayerf_OLD.cg",
+#else
+	"bayerf.cg",
+#endif
+	"bayersuperf.cg"
+};
+
+const char *BayerRenderer::PATTERN_ARGS[][2] =
+{
+	{ "-DRED_X=0", "-DRED_Y=0" },	// RGGB
+	{ "-DRED_X=1", "-DRED_Y=0" },	// GRBG
+	{ "-DRED_X=1", "-DRED_Y=1" },	// BGGR
+	{ "-DRED_X=0", "-DRED_Y=1" }	// GBRG
 };
 
 BayerRenderer::BayerRenderer () : width (0),
-				  height (0)
+				  height (0),
+				  shading_w (1),
+				  shading_h (1),
+				  rt (NULL),
+				  pbo_next (0),
+				  pbo_queued (-1),
+				  pbo_mapped (false),
+				  readback_next (0),
+				  readback_pending (0),
+				  readback (NULL),
+				  readback_data (NULL),
+				  context (NULL),
+				  vertexPosition (NULL),
+				  vertexTexCoord (NULL),
+				  fragmentVariant (NULL),
+				  adjustVariant (NULL),
+				  vbo (0),
+				  vao (0),
+				  quality (QUALITY_BILINEAR),
+				  pattern (PATTERN_GBRG)
 {
+	for (int i = 0; i < UPLOAD_BUFFERS; i++) {
+		pbo[i] = 0;
+	}
+	for (int i = 0; i < READBACK_BUFFERS; i++) {
+		pack[i] = 0;
+	}
+	for (int i = 0; i < QUALITY_LEVELS; i++) {
+		for (int p = 0; p < PATTERNS; p++) {
+			variants[i][p][0].program = variants[i][p][1].program = NULL;
+		}
+	}
 }
 
 BayerRenderer::~BayerRenderer ()
@@ -21,8 +68,23 @@ BayerRenderer::~BayerRenderer ()
 	if (rt != NULL) {
 		delete rt;
 	}
+	if (pbo[0] != 0) {
+		glDeleteBuffersARB (UPLOAD_BUFFERS, pbo);
+	}
+	if (pack[0] != 0) {
+		for (; readback_pending > 0; readback_pending--) {
+			glDeleteSync (fences[(readback_next - readback_pending + READBACK_BUFFERS) % READBACK_BUFFERS]);
+		}
+		glDeleteBuffersARB (READBACK_BUFFERS, pack);
+	}
+	if (vao != 0) {
+		glDeleteVertexArrays (1, &vao);
+	}
+	if (vbo != 0) {
+		glDeleteBuffersARB (1, &vbo);
+	}
 	glDeleteTextures (1, &tex_bayer);
-	glDeleteTextures (1, &tex_mask);
+	glDeleteTextures (1, &tex_shading);
 }
 
 bool
@@ -35,6 +97,16 @@ BayerRenderer::Initialize (CGcontext context,
 		std::cerr << "ERROR: GL_NV_texture_rectangle not supported" << std::endl;
 		return false;
 	}
+#ifndef PBUFFER
+	if (!GLEW_ARB_vertex_array_object) {
+		std::cerr << "ERROR: GL_ARB_vertex_array_object not supported" << std::endl;
+		return false;
+	}
+#endif
+	if (!GLEW_ARB_texture_rg) {
+		std::cerr << "ERROR: GL_ARB_texture_rg not supported" << std::endl;
+		return false;
+	}
 	// TODO check for vertex/fragment program extensions
 
 	// Register callback function for Cg errors and create an initial context.
@@ -45,8 +117,9 @@ BayerRenderer::Initialize (CGcontext context,
 	this->vertexProfile = vertexProfile;
 	this->fragmentProfile = fragmentProfile;
 	LoadCgPrograms ();
+	InitializeGeometry ();
 
-	// Create RenderTexture.
+	// Create render target.
 	rt = CreateRenderTexture (width, height);
 
 	// Set up bilinear interpolation.
@@ -57,8 +130,10 @@ BayerRenderer::Initialize (CGcontext context,
 	glTexParameterf (rt->GetTextureTarget (), GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 	glTexParameterf (rt->GetTextureTarget (), GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 
-	// Set up textures.
+	// Set up textures, and the programs that read them.
 	InitializeTextures ();
+	LoadVariants (pattern);
+	SetQuality (quality);
 
 	return true;
 }
@@ -102,44 +177,304 @@ BayerRenderer::LoadCgPrograms ()
 	// Enable the appropriate vertex profile and load the vertex program.
 	cgGLEnableProfile (vertexProfile);
 	cgGLLoadProgram (vertexProgram);
+	vertexPosition = cgGetNamedParameter (vertexProgram, "position");
+	vertexTexCoord = cgGetNamedParameter (vertexProgram, "texCoord");
 
-	// Compile and load the fragment program.
-	fragmentProgram = cgCreateProgramFromFile (
-		context,
-		CG_SOURCE,
-#ifdef BAYER
-		"bayerrawf.cg",
-#elif (defined(OLD))
-		"bayerf_OLD.cg",
-#else
-		"bayerf.cg",
-#endif
-		fragmentProfile,
-		"bayerf",	// entry point
-		NULL);		// arguments
-	if (!cgIsProgramCompiled (fragmentProgram)) {
-		cgCompileProgram (fragmentProgram);
-	}
-	// Enable the appropriate vertex profile and load the vertex program.
-	cgGLEnableProfile (fragmentProfile);
-	cgGLLoadProgram (fragmentProgram);
 	return true;
 }
 
+void
+BayerRenderer::LoadVariants (Pattern p)
+{
+	if (variants[0][p][0].program != NULL || !cgIsContext (context)) {
+		return;
+	}
+
+	// Compile and load the fragment programs for the pattern, plain
+	// and with the display adjustments.
+	for (int i = 0; i < QUALITY_LEVELS; i++) {
+		for (int adjust = 0; adjust < 2; adjust++) {
+			const char *args[] = {
+				PATTERN_ARGS[p][0],
+				PATTERN_ARGS[p][1],
+				adjust ? "-DADJUST" : NULL,
+				NULL
+			};
+			CGprogram program = cgCreateProgramFromFile (
+				context,
+				CG_SOURCE,
+				FRAGMENT_PROGRAMS[i],
+				fragmentProfile,
+				"bayerf",	// entry point
+				args);		// arguments
+			if (!cgIsProgramCompiled (program)) {
+				cgCompileProgram (program);
+			}
+			// Enable the fragment profile and load the fragment program.
+			cgGLEnableProfile (fragmentProfile);
+			cgGLLoadProgram (program);
+
+			// Look up the parameters, and associate the texture
+			// handles with the program.
+			Variant &v = variants[i][p][adjust];
+			v.program = program;
+			v.bayer = cgGetNamedParameter (program, "bayer");
+			v.shading = cgGetNamedParameter (program, "shading");
+			v.shadingScale = cgGetNamedParameter (program, "shadingScale");
+			v.shadingRange = cgGetNamedParameter (program, "shadingRange");
+			v.brightness = cgGetNamedParameter (program, "brightness");
+			v.contrast = cgGetNamedParameter (program, "contrast");
+			v.grayscale = cgGetNamedParameter (program, "grayscale");
+			cgGLSetTextureParameter (v.bayer, tex_bayer);
+			cgGLSetTextureParameter (v.shading, tex_shading);
+		}
+	}
+}
+
+void
+BayerRenderer::SetPattern (Pattern p)
+{
+	LoadVariants (p);
+	pattern = p;
+	SetQuality (quality);
+}
+
 void
 BayerRenderer::SetBayer (const GLubyte *bayer) const {
 	glBindTexture (GL_TEXTURE_RECTANGLE_NV, tex_bayer);
-	glTexSubImage2D (GL_TEXTURE_RECTANGLE_NV, 0, 0, 0, width, height, GL_LUMINANCE, GL_UNSIGNED_BYTE, bayer);
-	Render ();
+	glTexSubImage2D (GL_TEXTURE_RECTANGLE_NV, 0, 0, 0, width, height, GL_RED, GL_UNSIGNED_BYTE, bayer);
+	Render (NULL, 0);
+}
+
+void
+BayerRenderer::SetBayer (const GLubyte *bayer,
+			 const Rect *rects,
+			 int count) const {
+	glBindTexture (GL_TEXTURE_RECTANGLE_NV, tex_bayer);
+	glPixelStorei (GL_UNPACK_ROW_LENGTH, width);
+	for (int i = 0; i < count; i++) {
+		glPixelStorei (GL_UNPACK_SKIP_PIXELS, rects[i].x);
+		glPixelStorei (GL_UNPACK_SKIP_ROWS, rects[i].y);
+		glTexSubImage2D (GL_TEXTURE_RECTANGLE_NV, 0, rects[i].x, rects[i].y, rects[i].width, rects[i].height,
+				 GL_RED, GL_UNSIGNED_BYTE, bayer);
+	}
+	glPixelStorei (GL_UNPACK_SKIP_PIXELS, 0);
+	glPixelStorei (GL_UNPACK_SKIP_ROWS, 0);
+	glPixelStorei (GL_UNPACK_ROW_LENGTH, 0);
+	Render (rects, count);
+}
+
+void
+BayerRenderer::DrawBayer (const GLubyte *bayer,
+			  float brightness,
+			  float contrast,
+			  bool grayscale) const {
+	glBindTexture (GL_TEXTURE_RECTANGLE_NV, tex_bayer);
+	glTexSubImage2D (GL_TEXTURE_RECTANGLE_NV, 0, 0, 0, width, height, GL_RED, GL_UNSIGNED_BYTE, bayer);
+
+	// The quad is drawn in clip coordinates, so the caller's matrices
+	// do not matter.
+	cgGLSetParameter1f (adjustVariant->brightness, brightness);
+	cgGLSetParameter1f (adjustVariant->contrast, contrast);
+	cgGLSetParameter1f (adjustVariant->grayscale, grayscale);
+	Demosaic (*adjustVariant, NULL, 0);
+}
+
+GLubyte *
+BayerRenderer::MapBayer ()
+{
+	if (!GLEW_ARB_pixel_buffer_object) {
+		return NULL;
+	}
+	if (pbo[0] == 0) {
+		glGenBuffersARB (UPLOAD_BUFFERS, pbo);
+		for (int i = 0; i < UPLOAD_BUFFERS; i++) {
+			glBindBufferARB (GL_PIXEL_UNPACK_BUFFER_ARB, pbo[i]);
+			glBufferDataARB (GL_PIXEL_UNPACK_BUFFER_ARB, width * height, NULL, GL_STREAM_DRAW_ARB);
+		}
+	}
+	// The buffer was last uploaded two calls ago, so the GPU is done
+	// with it and mapping does not wait.
+	glBindBufferARB (GL_PIXEL_UNPACK_BUFFER_ARB, pbo[pbo_next]);
+	GLubyte *p = static_cast<GLubyte *>(glMapBufferARB (GL_PIXEL_UNPACK_BUFFER_ARB, GL_WRITE_ONLY_ARB));
+	glBindBufferARB (GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+	pbo_mapped = (p != NULL);
+	return p;
+}
+
+bool
+BayerRenderer::SetMappedBayer ()
+{
+	if (!pbo_mapped) {
+		return false;
+	}
+	glBindBufferARB (GL_PIXEL_UNPACK_BUFFER_ARB, pbo[pbo_next]);
+	glUnmapBufferARB (GL_PIXEL_UNPACK_BUFFER_ARB);
+	glBindBufferARB (GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+	pbo_mapped = false;
+
+	int previous = pbo_queued;
+	pbo_queued = pbo_next;
+	pbo_next = (pbo_next + 1) % UPLOAD_BUFFERS;
+	if (previous < 0) {
+		return false;
+	}
+	UploadBuffer (previous);
+	Render (NULL, 0);
+	return true;
+}
+
+bool
+BayerRenderer::FlushMappedBayer ()
+{
+	if (pbo_queued < 0) {
+		return false;
+	}
+	UploadBuffer (pbo_queued);
+	pbo_queued = -1;
+	Render (NULL, 0);
+	return true;
+}
+
+void
+BayerRenderer::SetReadback (ReadbackCallback callback,
+			    void *data)
+{
+	readback = callback;
+	readback_data = data;
+}
+
+bool
+BayerRenderer::ReadBack (int frame)
+{
+	if (readback == NULL || !GLEW_ARB_pixel_buffer_object || !GLEW_ARB_sync) {
+		return false;
+	}
+	if (pack[0] == 0) {
+		glGenBuffersARB (READBACK_BUFFERS, pack);
+		for (int i = 0; i < READBACK_BUFFERS; i++) {
+			glBindBufferARB (GL_PIXEL_PACK_BUFFER_ARB, pack[i]);
+			glBufferDataARB (GL_PIXEL_PACK_BUFFER_ARB, width * height * 3, NULL, GL_STREAM_READ_ARB);
+		}
+		glBindBufferARB (GL_PIXEL_PACK_BUFFER_ARB, 0);
+	}
+	if (readback_pending == READBACK_BUFFERS) {
+		DeliverReadback (true);
+	}
+
+	// Read into the buffer; glReadPixels returns as soon as the copy
+	// is queued.
+	rt->BeginCapture ();
+	GLint alignment;
+	glGetIntegerv (GL_PACK_ALIGNMENT, &alignment);
+	glPixelStorei (GL_PACK_ALIGNMENT, 1);
+	glBindBufferARB (GL_PIXEL_PACK_BUFFER_ARB, pack[readback_next]);
+	glReadPixels (0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+	glBindBufferARB (GL_PIXEL_PACK_BUFFER_ARB, 0);
+	glPixelStorei (GL_PACK_ALIGNMENT, alignment);
+	fences[readback_next] = glFenceSync (GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	rt->EndCapture ();
+
+	frames[readback_next] = frame;
+	readback_next = (readback_next + 1) % READBACK_BUFFERS;
+	readback_pending++;
+	PollReadback (false);
+	return true;
+}
+
+int
+BayerRenderer::PollReadback (bool wait)
+{
+	int delivered = 0;
+	while (readback_pending > 0 && DeliverReadback (wait)) {
+		delivered++;
+	}
+	return delivered;
+}
+
+bool
+BayerRenderer::DeliverReadback (bool wait)
+{
+	// Longest single wait, in nanoseconds.
+	static const GLuint64 TIMEOUT = 1000000000;
+	int i = (readback_next - readback_pending + READBACK_BUFFERS) % READBACK_BUFFERS;
+	GLenum status;
+
+	// The first wait flushes, so that the fence is sure to signal.
+	status = glClientWaitSync (fences[i], GL_SYNC_FLUSH_COMMANDS_BIT, wait ? TIMEOUT : 0);
+	while (wait && status == GL_TIMEOUT_EXPIRED) {
+		status = glClientWaitSync (fences[i], 0, TIMEOUT);
+	}
+	if (status == GL_TIMEOUT_EXPIRED) {
+		return false;
+	}
+	glDeleteSync (fences[i]);
+	readback_pending--;
+
+	glBindBufferARB (GL_PIXEL_PACK_BUFFER_ARB, pack[i]);
+	const GLubyte *rgb = static_cast<const GLubyte *>(glMapBufferARB (GL_PIXEL_PACK_BUFFER_ARB, GL_READ_ONLY_ARB));
+	if (rgb != NULL) {
+		if (readback != NULL) {
+			readback (rgb, frames[i], readback_data);
+		}
+		glUnmapBufferARB (GL_PIXEL_PACK_BUFFER_ARB);
+	}
+	glBindBufferARB (GL_PIXEL_PACK_BUFFER_ARB, 0);
+	return true;
+}
+
+void
+BayerRenderer::UploadBuffer (int i) const
+{
+	glBindBufferARB (GL_PIXEL_UNPACK_BUFFER_ARB, pbo[i]);
+	glBindTexture (GL_TEXTURE_RECTANGLE_NV, tex_bayer);
+	glTexSubImage2D (GL_TEXTURE_RECTANGLE_NV, 0, 0, 0, width, height, GL_RED, GL_UNSIGNED_BYTE, NULL);
+	glBindBufferARB (GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+}
+
+void
+BayerRenderer::CopyTo (GLuint tex) const
+{
+	rt->BeginCapture ();
+	glBindTexture (GL_TEXTURE_RECTANGLE_NV, tex);
+	glCopyTexSubImage2D (GL_TEXTURE_RECTANGLE_NV, 0, 0, 0, 0, 0, width, height);
+	rt->EndCapture ();
+}
+
+void
+BayerRenderer::SetShading (int grid_w,
+			   int grid_h,
+			   const GLfloat *gains)
+{
+	static const GLfloat UNITY[4] = {1.0, 1.0, 1.0, 1.0};
+	GLfloat *scaled;
+	int n, i;
+
+	if (gains == NULL) {
+		grid_w = grid_h = 1;
+		gains = UNITY;
+	}
+	shading_w = grid_w;
+	shading_h = grid_h;
+
+	// Store gains in a normalized 16-bit texture so they can be filtered.
+	n = 4 * grid_w * grid_h;
+	scaled = new GLfloat[n];
+	for (i = 0; i < n; i++) {
+		scaled[i] = gains[i] / SHADING_RANGE;
+	}
+	glBindTexture (GL_TEXTURE_RECTANGLE_NV, tex_shading);
+	glTexImage2D (GL_TEXTURE_RECTANGLE_NV, 0, GL_RGBA16, grid_w, grid_h, 0, GL_RGBA, GL_FLOAT, scaled);
+	delete [] scaled;
 }
 
-RenderTexture*
+RenderTarget*
 BayerRenderer::CreateRenderTexture (int w,
 				    int h) const
 {
-	RenderTexture *rt  = new RenderTexture (RENDERTEXTURE_INIT);
+	RenderTarget *rt  = new RenderTarget (RENDERTEXTURE_INIT);
 	if (!rt->Initialize(w, h)) {
-		std::cerr << "ERROR: RenderTexture initialization failed" << std::endl;
+		std::cerr << "ERROR: render target initialization failed" << std::endl;
 		return NULL;
 	}
 	rt->BeginCapture ();
@@ -164,58 +499,144 @@ BayerRenderer::InitializeTextures ()
 	glTexParameteri (GL_TEXTURE_RECTANGLE_NV, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 	glTexParameteri (GL_TEXTURE_RECTANGLE_NV, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 	glTexParameteri (GL_TEXTURE_RECTANGLE_NV, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTexImage2D (GL_TEXTURE_RECTANGLE_NV, 0, 1, width, height, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, NULL);
-	// Associate this texture handle with the fragment program.
-	cgGLSetTextureParameter (cgGetNamedParameter (fragmentProgram, "bayer"), tex_bayer);
+	glTexImage2D (GL_TEXTURE_RECTANGLE_NV, 0, GL_R8, width, height, 0, GL_RED, GL_UNSIGNED_BYTE, NULL);
 
-	glGenTextures (1, &tex_mask);
-	glBindTexture (GL_TEXTURE_2D, tex_mask);
-	glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTexImage2D (GL_TEXTURE_2D, 0, GL_RGBA, 2, 2, 0, GL_RGBA, GL_FLOAT, MASK);
-	// Associate this texture handle with the fragment program.
-	cgGLSetTextureParameter (cgGetNamedParameter (fragmentProgram, "mask"), tex_mask);
+	// Lens-shading gains, bilinearly upsampled by the texture unit.
+	glGenTextures (1, &tex_shading);
+	glBindTexture (GL_TEXTURE_RECTANGLE_NV, tex_shading);
+	glTexParameteri (GL_TEXTURE_RECTANGLE_NV, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri (GL_TEXTURE_RECTANGLE_NV, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri (GL_TEXTURE_RECTANGLE_NV, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri (GL_TEXTURE_RECTANGLE_NV, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	SetShading (1, 1, NULL);
 }
 
 void
-BayerRenderer::Render () const
+BayerRenderer::InitializeGeometry ()
 {
-	// TODO put quad in display list?
+	const GLfloat w = width;
+	const GLfloat h = height;
+	const GLfloat quad[4][4] = {
+		{-1, -1, 0, 0},
+		{ 1, -1, w, 0},
+		{ 1,  1, w, h},
+		{-1,  1, 0, h}
+	};
 
-	// Render color channels into RenderTexture
+	glGenBuffersARB (1, &vbo);
+	glBindBufferARB (GL_ARRAY_BUFFER_ARB, vbo);
+	glBufferDataARB (GL_ARRAY_BUFFER_ARB, sizeof (quad), quad, GL_STATIC_DRAW_ARB);
+
+#ifndef PBUFFER
+	// The vertex array object records the arrays, so that Demosaic
+	// only binds it.
+	glGenVertexArrays (1, &vao);
+	glBindVertexArray (vao);
+	SetVertexArrays ();
+	glBindVertexArray (0);
+#endif
+	glBindBufferARB (GL_ARRAY_BUFFER_ARB, 0);
+}
+
+void
+BayerRenderer::SetVertexArrays () const
+{
+	// Cg sets conventional or generic attributes, whichever the vertex
+	// profile reads.
+	cgGLSetParameterPointer (vertexPosition, 2, GL_FLOAT, 4 * sizeof (GLfloat), (const GLvoid *) 0);
+	cgGLSetParameterPointer (vertexTexCoord, 2, GL_FLOAT, 4 * sizeof (GLfloat), (const GLvoid *) (2 * sizeof (GLfloat)));
+	cgGLEnableClientState (vertexPosition);
+	cgGLEnableClientState (vertexTexCoord);
+}
+
+void
+BayerRenderer::BindGeometry () const
+{
+#ifdef PBUFFER
+	// Demosaic draws in the pbuffer's context as well as the window's,
+	// and vertex array objects are not shared between contexts, unlike
+	// the buffer, so point the arrays at it in the current one.
+	glBindBufferARB (GL_ARRAY_BUFFER_ARB, vbo);
+	SetVertexArrays ();
+	glBindBufferARB (GL_ARRAY_BUFFER_ARB, 0);
+#else
+	glBindVertexArray (vao);
+#endif
+}
+
+void
+BayerRenderer::UnbindGeometry () const
+{
+#ifdef PBUFFER
+	cgGLDisableClientState (vertexPosition);
+	cgGLDisableClientState (vertexTexCoord);
+#else
+	glBindVertexArray (0);
+#endif
+}
+
+void
+BayerRenderer::Render (const Rect *rects,
+		       int count) const
+{
+	// Render color channels into the render target
 	rt->BeginCapture ();
-	glClear (GL_COLOR_BUFFER_BIT);
+	if (rects == NULL) {
+		glClear (GL_COLOR_BUFFER_BIT);
+	}
+	Demosaic (*fragmentVariant, rects, count);
+	rt->EndCapture ();
+}
+
+void
+BayerRenderer::Demosaic (const Variant &variant,
+			 const Rect *rects,
+			 int count) const
+{
+	if (rects == NULL) {
+		count = 1;
+	} else {
+		glEnable (GL_SCISSOR_TEST);
+	}
 
 	// Bind the vertex and fragment programs.
 	cgGLBindProgram (vertexProgram);
 	cgGLEnableProfile (vertexProfile);
-	cgGLBindProgram (fragmentProgram);
+	cgGLBindProgram (variant.program);
 	cgGLEnableProfile (fragmentProfile);
-	
-//	cgGLSetParameter1f (cgGetNamedParameter (fragmentProgram, "brightness"), brightness);
-//	cgGLSetParameter1f (cgGetNamedParameter (fragmentProgram, "contrast"), contrast);
-//	cgGLSetParameter1f (cgGetNamedParameter (fragmentProgram, "grayscale"), grayscale);
+
+	// Map pixel centers onto lens-shading grid nodes.
+	cgGLSetParameter2f (variant.shadingScale,
+			    (width > 1) ? (shading_w - 1.0) / (width - 1.0) : 0.0,
+			    (height > 1) ? (shading_h - 1.0) / (height - 1.0) : 0.0);
+	cgGLSetParameter1f (variant.shadingRange, SHADING_RANGE);
 
 	// Enable textures for the fragment shader.
-	cgGLEnableTextureParameter (cgGetNamedParameter (fragmentProgram, "bayer"));
-	cgGLEnableTextureParameter (cgGetNamedParameter (fragmentProgram, "mask"));
+	cgGLEnableTextureParameter (variant.bayer);
+	cgGLEnableTextureParameter (variant.shading);
 
-	// Draw a full-screen quad.
-	glBegin (GL_QUADS);
-	glTexCoord2f (0, 0);          glVertex2f (-1, -1);
-	glTexCoord2f (width, 0);      glVertex2f (1, -1);
-	glTexCoord2f (width, height); glVertex2f (1, 1);
-	glTexCoord2f (0, height);     glVertex2f (-1, 1);
-        glEnd();
+	// Draw a full-screen quad, scissored to each rectangle and the
+	// pixels around it whose kernels read it.
+	BindGeometry ();
+	for (int i = 0; i < count; i++) {
+		if (rects != NULL) {
+			int x0 = (rects[i].x > HALO) ? rects[i].x - HALO : 0;
+			int y0 = (rects[i].y > HALO) ? rects[i].y - HALO : 0;
+			int x1 = (rects[i].x + rects[i].width + HALO < width) ? rects[i].x + rects[i].width + HALO : width;
+			int y1 = (rects[i].y + rects[i].height + HALO < height) ? rects[i].y + rects[i].height + HALO : height;
+			glScissor (x0, y0, x1 - x0, y1 - y0);
+		}
+		glDrawArrays (GL_TRIANGLE_FAN, 0, 4);
+	}
+	UnbindGeometry ();
+	if (rects != NULL) {
+		glDisable (GL_SCISSOR_TEST);
+	}
 
 	// Disable textures for the fragment shader.
-	cgGLDisableTextureParameter (cgGetNamedParameter (fragmentProgram, "bayer"));
-	cgGLDisableTextureParameter (cgGetNamedParameter (fragmentProgram, "mask"));
+	cgGLDisableTextureParameter (variant.bayer);
+	cgGLDisableTextureParameter (variant.shading);
 
 	cgGLDisableProfile (vertexProfile);
 	cgGLDisableProfile (fragmentProfile);
-
-	rt->EndCapture ();
 }
@@ -16,7 +16,15 @@
 #include <GL/glext.h>
 #include <Cg/cg.h>
 #include <Cg/cgGL.h>
-#include "RenderTexture.h"
+#ifdef PBUFFER
+# include "RenderTexture.h"
+/// Render target: a pbuffer, with a context of its own.
+typedef RenderTexture RenderTarget;
+#else
+# include "FramebufferTexture.hpp"
+/// Render target: a framebuffer object in the current context.
+typedef FramebufferTexture RenderTarget;
+#endif
 
 /**
  * Bayer pattern image renderer.  Renders a Bayer pattern image in
@@ -24,6 +32,46 @@
  */
 class BayerRenderer {
 public:
+	/// Demosaicing algorithms, from best to fastest.
+	enum Quality {
+		QUALITY_HIGH = 0,	///< Gradient-corrected 5x5 (bayerhqf.cg).
+		QUALITY_BILINEAR,	///< Bilinear 3x3 (bayerf.cg).
+		QUALITY_SUPERPIXEL,	///< One colour per 2x2 quad (bayersuperf.cg).
+		QUALITY_LEVELS
+	};
+
+	/// Colour filter layouts, named by the first two pixels of the
+	/// first two rows as passed to SetBayer (the bottom rows of the
+	/// image as drawn), like BayerTile in bayer_viewer_ogl.
+	enum Pattern {
+		PATTERN_RGGB = 0,
+		PATTERN_GRBG,
+		PATTERN_BGGR,
+		PATTERN_GBRG,
+		PATTERNS
+	};
+
+	/// Rectangle of the image, in pixels.
+	struct Rect {
+		int x;		///< Left column.
+		int y;		///< Bottom row.
+		int width;	///< Columns.
+		int height;	///< Rows.
+	};
+
+	/**
+	 * Receives a frame read back by ReadBack.  It must not call back
+	 * into the renderer.
+	 *
+	 * @param rgb	width x height RGB pixels, bottom row first, valid
+	 *		only during the call.
+	 * @param frame	the frame number given to ReadBack.
+	 * @param data	the pointer given to SetReadback.
+	 */
+	typedef void (*ReadbackCallback) (const GLubyte *rgb,
+					  int frame,
+					  void *data);
+
 	/** 
 	 * Constructor.
 	 */
@@ -67,7 +115,155 @@ public:
 	 * Updates Bayer texture from image data in memory and renders to texture.
 	 */
 	void SetBayer (const GLubyte *) const;
+
+	/**
+	 * Updates only the given rectangles of the Bayer texture, and
+	 * renders only the pixels whose colour they can change.  The
+	 * rest of the render target keeps the previous frame.
+	 *
+	 * @param bayer		the whole image.
+	 * @param rects		the changed rectangles, within the image.
+	 * @param count		the number of rectangles.
+	 */
+	void SetBayer (const GLubyte *bayer,
+		       const Rect *rects,
+		       int count) const;
+
+	/**
+	 * Updates the Bayer texture and demosaics it straight into the
+	 * current framebuffer, adjusting it as imagef.cg does, in one pass
+	 * that skips the render target.  For the common case of the image
+	 * shown unrotated at one texel per pixel: the quad covers the
+	 * viewport, which should be width x height pixels.  The render
+	 * target keeps the previous frame.
+	 *
+	 * @param bayer		the whole image.
+	 * @param brightness	the brightness scale.
+	 * @param contrast	the contrast scale, around 0.5.
+	 * @param grayscale	convert to grayscale.
+	 */
+	void DrawBayer (const GLubyte *bayer,
+			float brightness,
+			float contrast,
+			bool grayscale) const;
+
+	/**
+	 * Maps the next pixel buffer of the upload ring, for the caller
+	 * to write a frame into directly instead of passing it to
+	 * SetBayer.  Hand it back with SetMappedBayer.
+	 *
+	 * @return	width x height bytes of write-only memory, or NULL if
+	 *		pixel buffer objects are not supported.
+	 */
+	GLubyte *MapBayer ();
+
+	/**
+	 * Unmaps the buffer returned by MapBayer and queues it.  The Bayer
+	 * texture is updated from the buffer queued by the previous call,
+	 * and that frame is rendered, so each transfer has a frame's time
+	 * to complete while the caller fills the next buffer.
+	 *
+	 * @return	true if a frame was rendered; false on the first call,
+	 *		or if no buffer is mapped.
+	 */
+	bool SetMappedBayer ();
+
+	/**
+	 * Updates the Bayer texture from the queued buffer, if any, and
+	 * renders it.  Call after the last SetMappedBayer.
+	 *
+	 * @return	true if a frame was rendered.
+	 */
+	bool FlushMappedBayer ();
+
+	/**
+	 * Sets the function that receives frames read back by ReadBack.
+	 *
+	 * @param callback	the function, or NULL.
+	 * @param data		passed on to it.
+	 */
+	void SetReadback (ReadbackCallback callback,
+			  void *data);
+
+	/**
+	 * Starts reading the rendered image back into a ring of pixel pack
+	 * buffers without waiting for it.  The frame is passed to the
+	 * readback callback once a fence shows the GPU has written it,
+	 * usually by a ReadBack or PollReadback a frame or two later.
+	 * When all #READBACK_BUFFERS are in flight, waits for the oldest.
+	 *
+	 * @param frame	a number passed on to the callback.
+	 *
+	 * @return	false if there is no callback, or pixel buffer
+	 *		objects or sync objects are not supported.
+	 */
+	bool ReadBack (int frame);
+
+	/**
+	 * Passes finished frames to the readback callback, oldest first.
+	 *
+	 * @param wait	wait for all frames in flight.
+	 *
+	 * @return	the number of frames passed on.
+	 */
+	int PollReadback (bool wait);
 	
+	/**
+	 * Sets the lens-shading gain grid applied while demosaicing, to
+	 * each sample before it is interpolated.  The grid is bilinearly
+	 * upsampled so that its corner nodes fall on the corner pixels of
+	 * the image.  Gains are clamped to [0, #SHADING_RANGE].
+	 *
+	 * @param grid_w	the grid width.
+	 * @param grid_h	the grid height.
+	 * @param gains		grid_w x grid_h RGBA gains for the red sites,
+	 *			the greens in rows of blue, the blue sites and
+	 *			the greens in rows of red, or NULL to disable
+	 *			correction.  bayer_viewer_ogl's BayerShading
+	 *			keeps one grid per quad position instead;
+	 *			gp_bayer_shading_rgba converts it for the tile
+	 *			matching the current pattern.
+	 */
+	void SetShading (int grid_w,
+			 int grid_h,
+			 const GLfloat *gains);
+
+	/**
+	 * Sets the demosaicing algorithm used by SetBayer.
+	 *
+	 * @param quality	the algorithm.
+	 */
+	void SetQuality (Quality quality);
+
+	/**
+	 * Gets the demosaicing algorithm used by SetBayer.
+	 *
+	 * @return	the algorithm.
+	 */
+	Quality GetQuality () const;
+
+	/**
+	 * Sets the colour filter layout of the images.  Its programs are
+	 * compiled the first time it is used, then kept.
+	 *
+	 * @param pattern	the layout.
+	 */
+	void SetPattern (Pattern pattern);
+
+	/**
+	 * Gets the colour filter layout of the images.
+	 *
+	 * @return	the layout.
+	 */
+	Pattern GetPattern () const;
+
+	/**
+	 * Copies the rendered image into a texture of the same size.
+	 *
+	 * @param tex	the GL_TEXTURE_RECTANGLE_NV texture.
+	 */
+	void CopyTo (GLuint tex) const;
+
 	/**
 	 * Binds the texture to the active texture unit.
 	 */
@@ -112,11 +308,21 @@ public:
 	void SetHeight (int height);
 	
 private:
-	/// Initialization string for RenderTexture.
+	/// Initialization (mode) string for the render target.
 	static const char *RENDERTEXTURE_INIT;
 
-	/// Colormask texture.
-	static const GLfloat MASK[];
+	/// Largest lens-shading gain.
+	static const GLfloat SHADING_RANGE;
+
+	/// Reach of the widest kernel, in pixels.
+	static const int HALO;
+
+	/// Fragment program file for each quality level.
+	static const char *FRAGMENT_PROGRAMS[QUALITY_LEVELS];
+
+	/// Compiler arguments placing the red sites of each pattern (see
+	/// pattern.cg).
+	static const char *PATTERN_ARGS[PATTERNS][2];
 	
 	/// Image width.
 	int width;
@@ -126,10 +332,50 @@ private:
 
 	/// Texture ids.
 	GLuint tex_bayer;
-	GLuint tex_mask;
+	GLuint tex_shading;
+
+	/// Lens-shading grid dimensions.
+	int shading_w;
+	int shading_h;
+
+	/// Render target the image is converted into.
+	RenderTarget *rt;
+
+	/// Number of pixel buffers in the upload ring.
+	static const int UPLOAD_BUFFERS = 3;
+
+	/// Upload ring, created by the first MapBayer.
+	GLuint pbo[UPLOAD_BUFFERS];
+
+	/// Buffer MapBayer maps next.
+	int pbo_next;
+
+	/// Buffer waiting to be uploaded, or -1.
+	int pbo_queued;
 
-	/// RenderTexture
-	RenderTexture *rt;
+	/// True while pbo[pbo_next] is mapped.
+	bool pbo_mapped;
+
+	/// Number of pixel buffers in the readback ring.
+	static const int READBACK_BUFFERS = 3;
+
+	/// Readback ring, created by the first ReadBack.
+	GLuint pack[READBACK_BUFFERS];
+
+	/// Fences after the reads into each buffer, and their frame numbers.
+	GLsync fences[READBACK_BUFFERS];
+	int frames[READBACK_BUFFERS];
+
+	/// Buffer ReadBack uses next.
+	int readback_next;
+
+	/// Frames in flight, in the readback_pending buffers before
+	/// readback_next.
+	int readback_pending;
+
+	/// Readback callback and its data.
+	ReadbackCallback readback;
+	void *readback_data;
 
 	// Cg context.
 	CGcontext context;
@@ -143,19 +389,54 @@ private:
 	/// Cg vertex program handle.
 	CGprogram vertexProgram;
 
-	/// Cg fragment program handle.
-	CGprogram fragmentProgram;
+	/// Varying parameters of the vertex program, fed from #vbo.
+	CGparameter vertexPosition;
+	CGparameter vertexTexCoord;
+
+	/// A fragment program and its parameter handles, looked up once
+	/// when it is loaded.
+	struct Variant {
+		CGprogram program;
+		CGparameter bayer;
+		CGparameter shading;
+		CGparameter shadingScale;
+		CGparameter shadingRange;
+		CGparameter brightness;		///< Only with -DADJUST.
+		CGparameter contrast;		///< Only with -DADJUST.
+		CGparameter grayscale;		///< Only with -DADJUST.
+	};
+
+	/// Cg fragment programs for each quality level and pattern, plain
+	/// [0] and with the display adjustments (-DADJUST) for DrawBayer
+	/// [1].  Programs are 0 until the pattern is first used.
+	Variant variants[QUALITY_LEVELS][PATTERNS][2];
+
+	/// Cg fragment programs of the current quality level and pattern,
+	/// plain and adjusting.
+	const Variant *fragmentVariant;
+	const Variant *adjustVariant;
+
+	/// Full-screen quad, as a triangle fan of (x, y, s, t) vertices,
+	/// and the vertex array object drawing it (not in -DPBUFFER builds).
+	GLuint vbo;
+	GLuint vao;
+
+	/// Current quality level.
+	Quality quality;
+
+	/// Current colour filter layout.
+	Pattern pattern;
 
 private:
 	/** 
-	 * Creates and sets defaults for a RenderTexture object.
+	 * Creates and sets defaults for a render target.
 	 * 
-	 * @param w	width of the RenderTexture object.
-	 * @param h	height of the RenderTexture object.
+	 * @param w	width of the render target.
+	 * @param h	height of the render target.
 	 * 
-	 * @return	a pointer to the new RenderTexture object, or NULL on failure.
+	 * @return	a pointer to the new render target, or NULL on failure.
 	 */
-	RenderTexture* CreateRenderTexture (int w,
+	RenderTarget* CreateRenderTexture (int w,
 					    int h) const;
 
 	/** 
@@ -163,10 +444,67 @@ private:
 	 */
 	void InitializeTextures ();
 
+	/**
+	 * Updates the Bayer texture from a buffer of the upload ring.
+	 *
+	 * @param i	the buffer.
+	 */
+	void UploadBuffer (int i) const;
+
+	/**
+	 * Passes the oldest frame in flight to the readback callback once
+	 * the GPU has written it.
+	 *
+	 * @param wait	wait for it.
+	 *
+	 * @return	true if it was passed on.
+	 */
+	bool DeliverReadback (bool wait);
+
 	/** 
 	 * Performs conversion of Bayer image to RGB image.
+	 *
+	 * @param rects		rectangles to convert, grown by #HALO, or NULL
+	 *			to convert the whole image.
+	 * @param count		the number of rectangles.
+	 */
+	void Render (const Rect *rects,
+		     int count) const;
+
+	/**
+	 * Draws the quad covering the viewport with a demosaicing program.
+	 *
+	 * @param variant	the fragment program.
+	 * @param rects		rectangles to draw, grown by #HALO, or NULL
+	 *			to draw the whole image.
+	 * @param count		the number of rectangles.
+	 */
+	void Demosaic (const Variant &variant,
+		       const Rect *rects,
+		       int count) const;
+
+	/**
+	 * Creates the vertex buffer and vertex array object of the quad.
+	 */
+	void InitializeGeometry ();
+
+	/**
+	 * Points the vertex program's varying parameters at the bound
+	 * vertex buffer, and enables them.
+	 */
+	void SetVertexArrays () const;
+
+	/**
+	 * Sets up the quad for drawing in the current context: binds the
+	 * vertex array object, or with -DPBUFFER, where it may belong to
+	 * another context, sets the arrays up again.
 	 */
-	void Render () const;
+	void BindGeometry () const;
+
+	/**
+	 * Undoes BindGeometry.
+	 */
+	void UnbindGeometry () const;
 
 	/** 
 	 * Loads the Cg programs.
@@ -174,6 +512,14 @@ private:
 	 * @return	True if programs load successfully.
 	 */
 	bool LoadCgPrograms ();
+
+	/**
+	 * Compiles and loads the fragment programs of a pattern, unless
+	 * they are already, and binds the textures to them.
+	 *
+	 * @param p	the pattern.
+	 */
+	void LoadVariants (Pattern p);
 };
 
 inline int
@@ -196,6 +542,23 @@ BayerRenderer::SetHeight (int h) {
 	height = h;
 }
 
+inline void
+BayerRenderer::SetQuality (Quality q) {
+	quality = q;
+	fragmentVariant = &variants[q][pattern][0];
+	adjustVariant = &variants[q][pattern][1];
+}
+
+inline BayerRenderer::Quality
+BayerRenderer::GetQuality () const {
+	return quality;
+}
+
+inline BayerRenderer::Pattern
+BayerRenderer::GetPattern () const {
+	return pattern;
+}
+
 inline void
 BayerRenderer::Bind () const
 {
@@ -0,0 +1,106 @@
+#include <cstring>
+#include "FrameCache.hpp"
+
+FrameCache::FrameCache (int capacity,
+			int width,
+			int height) :
+	capacity (capacity),
+	width (width),
+	height (height),
+	clock (0),
+	hits (0),
+	misses (0)
+{
+	entries = new Entry[capacity];
+	for (int i = 0; i < capacity; i++) {
+		entries[i].hash = 0;
+		entries[i].tag = 0;
+		entries[i].tex = 0;
+		entries[i].used = 0;
+	}
+}
+
+FrameCache::~FrameCache ()
+{
+	for (int i = 0; i < capacity; i++) {
+		if (entries[i].tex != 0) {
+			glDeleteTextures (1, &entries[i].tex);
+		}
+	}
+	delete [] entries;
+}
+
+unsigned long long
+FrameCache::hash (const GLubyte *data,
+		  size_t size)
+{
+	const unsigned long long PRIME = 0x100000001b3ULL;
+	unsigned long long h = 0xcbf29ce484222325ULL;
+	unsigned long long word;
+	size_t i;
+
+	for (i = 0; i + 8 <= size; i += 8) {
+		memcpy (&word, data + i, 8);
+		h = (h ^ word) * PRIME;
+	}
+	for (; i < size; i++) {
+		h = (h ^ data[i]) * PRIME;
+	}
+	// Spread the high bits of the last multiply into the low ones.
+	h ^= h >> 29;
+	return h;
+}
+
+GLuint
+FrameCache::find (unsigned long long hash,
+		  int tag)
+{
+	clock++;
+	for (int i = 0; i < capacity; i++) {
+		if (entries[i].used != 0 && entries[i].hash == hash && entries[i].tag == tag) {
+			entries[i].used = clock;
+			hits++;
+			return entries[i].tex;
+		}
+	}
+	misses++;
+	return 0;
+}
+
+GLuint
+FrameCache::insert (unsigned long long hash,
+		    int tag)
+{
+	int lru = 0;
+
+	for (int i = 1; i < capacity; i++) {
+		if (entries[i].used < entries[lru].used) {
+			lru = i;
+		}
+	}
+	Entry &e = entries[lru];
+	if (e.tex == 0) {
+		glGenTextures (1, &e.tex);
+		glBindTexture (GL_TEXTURE_RECTANGLE_NV, e.tex);
+		glTexParameterf (GL_TEXTURE_RECTANGLE_NV, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameterf (GL_TEXTURE_RECTANGLE_NV, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameterf (GL_TEXTURE_RECTANGLE_NV, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameterf (GL_TEXTURE_RECTANGLE_NV, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexImage2D (GL_TEXTURE_RECTANGLE_NV, 0, GL_RGB8, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+	}
+	e.hash = hash;
+	e.tag = tag;
+	e.used = ++clock;
+	return e.tex;
+}
+
+void
+FrameCache::clear ()
+{
+	for (int i = 0; i < capacity; i++) {
+		entries[i].used = 0;
+	}
+	clock = 0;
+	hits = 0;
+	misses = 0;
+}
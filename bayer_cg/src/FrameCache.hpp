@@ -0,0 +1,144 @@
+/**
+ * @file   FrameCache.hpp
+ * @brief  Cache of demosaiced frames, keyed by a hash of the Bayer data.
+ */
+
+#ifndef FRAMECACHE_HPP
+#define FRAMECACHE_HPP
+
+#include <cstddef>
+#include <GL/glew.h>
+
+/**
+ * Frame cache.  Holds up to a fixed number of demosaiced frames in RGB
+ * textures, keyed by a hash of the Bayer frame they were rendered from
+ * and a tag for anything else the result depends on, such as the
+ * quality level.  When full, the least recently used frame is replaced.
+ *
+ * USAGE:
+ *	FrameCache cache (16, width, height);
+ *	GLuint tex = cache.find (hash, quality);
+ *	if (tex == 0) {
+ *		// demosaic, then copy the result into cache.insert (hash, quality)
+ *	}
+ */
+class FrameCache
+{
+public:
+	/**
+	 * Constructor.  Textures are created as frames are inserted.
+	 *
+	 * @param capacity	the number of frames held, at least 1.
+	 * @param width		the frame width.
+	 * @param height	the frame height.
+	 */
+	FrameCache (int capacity,
+		    int width,
+		    int height);
+
+	/**
+	 * Destructor.
+	 */
+	~FrameCache ();
+
+	/**
+	 * Hashes a frame.  Not cryptographic: 64-bit FNV-1a over 8-byte
+	 * words, fast enough to run on every frame as it is loaded.
+	 *
+	 * @param data		the frame.
+	 * @param size		its size in bytes.
+	 *
+	 * @return	the hash.
+	 */
+	static unsigned long long hash (const GLubyte *data,
+					size_t size);
+
+	/**
+	 * Looks a frame up, counting a hit or a miss.
+	 *
+	 * @param hash		the hash of the Bayer frame.
+	 * @param tag		what else the result depends on.
+	 *
+	 * @return	the texture holding the demosaiced frame, or 0 if
+	 *		it is not cached.
+	 */
+	GLuint find (unsigned long long hash,
+		     int tag);
+
+	/**
+	 * Makes room for a frame, replacing the least recently used one.
+	 *
+	 * @param hash		the hash of the Bayer frame.
+	 * @param tag		what else the result depends on.
+	 *
+	 * @return	the texture to copy the demosaiced frame into.
+	 */
+	GLuint insert (unsigned long long hash,
+		       int tag);
+
+	/**
+	 * Forgets all frames and resets the counters.
+	 */
+	void clear ();
+
+	/**
+	 * Returns the number of frames held.
+	 */
+	int get_capacity () const;
+
+	/**
+	 * Returns the number of lookups that found their frame.
+	 */
+	unsigned long get_hits () const;
+
+	/**
+	 * Returns the number of lookups that did not.
+	 */
+	unsigned long get_misses () const;
+
+private:
+	/// A cached frame.
+	struct Entry {
+		unsigned long long hash;
+		int tag;
+		GLuint tex;		///< 0 until first used.
+		unsigned long used;	///< Lookup clock at last use, 0 if empty.
+	};
+
+	/// Frames.
+	Entry *entries;
+
+	/// Number of entries.
+	int capacity;
+
+	/// Frame dimensions.
+	int width;
+	int height;
+
+	/// Incremented on every lookup and insertion.
+	unsigned long clock;
+
+	/// Lookup counters.
+	unsigned long hits;
+	unsigned long misses;
+};
+
+inline int
+FrameCache::get_capacity () const
+{
+	return capacity;
+}
+
+inline unsigned long
+FrameCache::get_hits () const
+{
+	return hits;
+}
+
+inline unsigned long
+FrameCache::get_misses () const
+{
+	return misses;
+}
+
+#endif // FRAMECACHE_HPP
@@ -0,0 +1,92 @@
+/**
+ * @file   OffscreenContext.hpp
+ * @brief  OpenGL context with no window, through EGL.
+ */
+
+#ifndef OFFSCREENCONTEXT_HPP
+#define OFFSCREENCONTEXT_HPP
+
+#include <GL/glew.h>
+
+/**
+ * Offscreen OpenGL context.  Stands in for the GLUT window where there is
+ * no display: a surfaceless EGL context (EGL_KHR_surfaceless_context),
+ * preferably on Mesa's surfaceless platform, which needs neither an X
+ * server nor a GPU when it runs on llvmpipe.
+ *
+ * The context has no default framebuffer, so Initialize binds a
+ * framebuffer object of the given size in its place.  Whatever would have
+ * been drawn to the window is drawn there and read back with
+ * glReadPixels.  GLEW is initialized along with the context.
+ *
+ * USAGE:
+ *	OffscreenContext context;
+ *	if (context.Initialize (width, height)) {
+ *		// create renderers and draw as in a window
+ *		glReadPixels (0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, p);
+ *	}
+ */
+class OffscreenContext
+{
+public:
+	/**
+	 * Constructor.
+	 */
+	OffscreenContext ();
+
+	/**
+	 * Destructor.  Releases the context.
+	 */
+	~OffscreenContext ();
+
+	/**
+	 * Creates the context, makes it current, initializes GLEW and binds
+	 * a width x height RGBA framebuffer.
+	 *
+	 * @param width		the framebuffer width.
+	 * @param height	the framebuffer height.
+	 *
+	 * @return	true on success.
+	 */
+	bool Initialize (int width,
+			 int height);
+
+	/**
+	 * Returns the framebuffer width.
+	 */
+	int GetWidth () const;
+
+	/**
+	 * Returns the framebuffer height.
+	 */
+	int GetHeight () const;
+
+private:
+	/// EGL display and context (EGLDisplay and EGLContext), kept
+	/// opaque so that users need not include the EGL headers.
+	void *display;
+	void *context;
+
+	/// Framebuffer object standing in for the window, and its colour
+	/// renderbuffer.
+	GLuint fbo;
+	GLuint color;
+
+	/// Framebuffer dimensions.
+	int width;
+	int height;
+};
+
+inline int
+OffscreenContext::GetWidth () const
+{
+	return width;
+}
+
+inline int
+OffscreenContext::GetHeight () const
+{
+	return height;
+}
+
+#endif // OFFSCREENCONTEXT_HPP
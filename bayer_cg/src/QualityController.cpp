@@ -0,0 +1,99 @@
+#ifdef _WIN32
+# include <windows.h>
+#else
+# include <sys/time.h>
+#endif
+#include <cstddef>
+#include "QualityController.hpp"
+
+const double QualityController::SMOOTHING = 0.25;
+const double QualityController::STEP_UP = 0.8;
+const int QualityController::SETTLE = 8;
+
+QualityController::QualityController (int levels,
+				      double budget) :
+	levels (levels),
+	level (0),
+	budget (budget),
+	time (-1.0),
+	settle (SETTLE),
+	previous_level (0),
+	previous_time (-1.0)
+{
+	// Until measured, assume each level costs twice the next.
+	ratio = new double[levels];
+	for (int i = 0; i < levels; i++) {
+		ratio[i] = 2.0;
+	}
+}
+
+QualityController::~QualityController ()
+{
+	delete [] ratio;
+}
+
+void
+QualityController::set_level (int l)
+{
+	if (l < 0) {
+		l = 0;
+	} else if (l > levels - 1) {
+		l = levels - 1;
+	}
+	change (l);
+	previous_time = -1.0;
+}
+
+void
+QualityController::change (int l)
+{
+	previous_level = level;
+	previous_time = time;
+	level = l;
+	time = -1.0;
+	settle = SETTLE;
+}
+
+bool
+QualityController::update (double seconds)
+{
+	time = (time < 0.0) ? seconds : time + SMOOTHING * (seconds - time);
+	if (settle > 0) {
+		if (--settle > 0) {
+			return false;
+		}
+		// Settled: measure the cost ratio across the last change.
+		if (previous_time > 0.0 && time > 0.0 &&
+		    (previous_level == level - 1 || previous_level == level + 1)) {
+			int k = (previous_level > level) ? previous_level : level;
+			double r = (k == level) ? previous_time / time : time / previous_time;
+			ratio[k] = (r < 1.0) ? 1.0 : r;
+		}
+		previous_time = -1.0;
+	}
+
+	if (time > budget && level < levels - 1) {
+		change (level + 1);
+		return true;
+	}
+	if (level > 0 && time * ratio[level] < STEP_UP * budget) {
+		change (level - 1);
+		return true;
+	}
+	return false;
+}
+
+double
+QualityController::now ()
+{
+#ifdef _WIN32
+	LARGE_INTEGER count, freq;
+	QueryPerformanceCounter (&count);
+	QueryPerformanceFrequency (&freq);
+	return static_cast<double>(count.QuadPart) / freq.QuadPart;
+#else
+	struct timeval tv;
+	gettimeofday (&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1.0e6;
+#endif
+}
@@ -1,11 +1,11 @@
+#include <cstring>
 #include <iostream>
-#include "RenderTexture.h"
 #include "BayerRenderer.hpp"
 
-const int BayerRenderer::REQUIRED_TEXTURE_UNITS = 4;
 const float BayerRenderer::OFFSET = 0.375;
-const float BayerRenderer::BLEND[4] = {0.0, 0.0, 0.0, 0.5};
+const float BayerRenderer::BLEND[4] = {1.0, 0.5, 1.0, 1.0};
 const char *BayerRenderer::RENDERTEXTURE_INIT = "rgba texRECT";
+const int BayerRenderer::HALO = 4;
 
 const int BayerRenderer::OFFSET_RED[2]    = {-1,  0};
 const int BayerRenderer::OFFSET_BLUE[2]   = { 0, -1};
@@ -13,8 +13,26 @@ const int BayerRenderer::OFFSET_GREEN1[2] = { 0,  0};
 const int BayerRenderer::OFFSET_GREEN2[2] = {-1, -1};
 
 BayerRenderer::BayerRenderer () : width (0),
-				  height (0)
+				  height (0),
+				  tex_bayer (0),
+				  vbo (0),
+				  vao (0),
+				  rt (NULL),
+				  channels (NULL),
+				  pbo_next (0),
+				  pbo_queued (-1),
+				  pbo_mapped (false),
+				  readback_next (0),
+				  readback_pending (0),
+				  readback (NULL),
+				  readback_data (NULL)
 {
+	for (int i = 0; i < UPLOAD_BUFFERS; i++) {
+		pbo[i] = 0;
+	}
+	for (int i = 0; i < READBACK_BUFFERS; i++) {
+		pack[i] = 0;
+	}
 }
 
 BayerRenderer::~BayerRenderer ()
@@ -22,15 +40,30 @@ BayerRenderer::~BayerRenderer ()
 	if (rt != NULL) {
 		delete rt;
 	}
-	glDeleteTextures (5, tex);
-	glDeleteLists (texMagList, 6);
+	if (channels != NULL) {
+		delete channels;
+	}
+	if (pbo[0] != 0) {
+		glDeleteBuffersARB (UPLOAD_BUFFERS, pbo);
+	}
+	if (pack[0] != 0) {
+		for (; readback_pending > 0; readback_pending--) {
+			glDeleteSync (fences[(readback_next - readback_pending + READBACK_BUFFERS) % READBACK_BUFFERS]);
+		}
+		glDeleteBuffersARB (READBACK_BUFFERS, pack);
+	}
+	glDeleteTextures (1, &tex_bayer);
+	if (vao != 0) {
+		glDeleteVertexArrays (1, &vao);
+	}
+	if (vbo != 0) {
+		glDeleteBuffersARB (1, &vbo);
+	}
 }
 
 bool
 BayerRenderer::Initialize ()
 {
-	int num_tex_units;
-
 	// Check for required extensions
 	if (!GLEW_NV_texture_rectangle) {
 		std::cerr << "ERROR: GL_NV_texture_rectangle not supported" << std::endl;
@@ -40,35 +73,26 @@ BayerRenderer::Initialize ()
 		std::cerr << "ERROR: GL_ARB_texture_env_combine not supported" << std::endl;
 		return false;
 	}
-	if (!GLEW_ARB_multitexture) {
-		std::cerr << "ERROR: GL_ARB_multitexture not supported" << std::endl;
+#ifndef PBUFFER
+	if (!GLEW_ARB_vertex_array_object) {
+		std::cerr << "ERROR: GL_ARB_vertex_array_object not supported" << std::endl;
 		return false;
 	}
+#endif
 
-	// Check for required number of texture units
-	glGetIntegerv (GL_MAX_TEXTURE_UNITS, &num_tex_units);
-	if (num_tex_units < REQUIRED_TEXTURE_UNITS) {
-		std::cerr << "ERROR: Requires " << REQUIRED_TEXTURE_UNITS << " texture units (" << num_tex_units << " available)" << std::endl;
+	// Create render targets, with bilinear interpolation
+	rt = CreateRenderTexture (width, height);
+	channels = CreateRenderTexture (width/2, height/2);
+	if (rt == NULL || channels == NULL) {
 		return false;
 	}
 
-	// Create RenderTexture
-	rt = CreateRenderTexture (width, height);
-
-	// Set up bilinear interpolation
-	rt->Bind ();
-	glTexParameterf (rt->GetTextureTarget (), GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameterf (rt->GetTextureTarget (), GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexParameterf (rt->GetTextureTarget (), GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameterf (rt->GetTextureTarget (), GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-
 	// Set up textures
 	InitializeTextures ();
 
-	// Create display lists
-	CreateMagnificationDisplayList ();
-	CreateMinificationDisplayLists ();
-	
+	// Set up geometry
+	InitializeGeometry ();
+
 	return true;
 }
 
@@ -84,9 +108,179 @@ BayerRenderer::Initialize (int w,
 
 void
 BayerRenderer::SetBayer (const GLubyte *bayer) const {
-	glBindTexture (GL_TEXTURE_RECTANGLE_NV, tex[BAYER]);
+	glBindTexture (GL_TEXTURE_RECTANGLE_NV, tex_bayer);
 	glTexSubImage2D (GL_TEXTURE_RECTANGLE_NV, 0, 0, 0, width, height, GL_LUMINANCE, GL_UNSIGNED_BYTE, bayer);
-	Render ();
+	Render (NULL, 0);
+}
+
+void
+BayerRenderer::SetBayer (const GLubyte *bayer,
+			 const Rect *rects,
+			 int count) const {
+	glBindTexture (GL_TEXTURE_RECTANGLE_NV, tex_bayer);
+	glPixelStorei (GL_UNPACK_ROW_LENGTH, width);
+	for (int i = 0; i < count; i++) {
+		glPixelStorei (GL_UNPACK_SKIP_PIXELS, rects[i].x);
+		glPixelStorei (GL_UNPACK_SKIP_ROWS, rects[i].y);
+		glTexSubImage2D (GL_TEXTURE_RECTANGLE_NV, 0, rects[i].x, rects[i].y, rects[i].width, rects[i].height,
+				 GL_LUMINANCE, GL_UNSIGNED_BYTE, bayer);
+	}
+	glPixelStorei (GL_UNPACK_SKIP_PIXELS, 0);
+	glPixelStorei (GL_UNPACK_SKIP_ROWS, 0);
+	glPixelStorei (GL_UNPACK_ROW_LENGTH, 0);
+	Render (rects, count);
+}
+
+GLubyte *
+BayerRenderer::MapBayer ()
+{
+	if (!GLEW_ARB_pixel_buffer_object) {
+		return NULL;
+	}
+	if (pbo[0] == 0) {
+		glGenBuffersARB (UPLOAD_BUFFERS, pbo);
+		for (int i = 0; i < UPLOAD_BUFFERS; i++) {
+			glBindBufferARB (GL_PIXEL_UNPACK_BUFFER_ARB, pbo[i]);
+			glBufferDataARB (GL_PIXEL_UNPACK_BUFFER_ARB, width * height, NULL, GL_STREAM_DRAW_ARB);
+		}
+	}
+	// The buffer was last uploaded two calls ago, so the GPU is done
+	// with it and mapping does not wait.
+	glBindBufferARB (GL_PIXEL_UNPACK_BUFFER_ARB, pbo[pbo_next]);
+	GLubyte *p = static_cast<GLubyte *>(glMapBufferARB (GL_PIXEL_UNPACK_BUFFER_ARB, GL_WRITE_ONLY_ARB));
+	glBindBufferARB (GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+	pbo_mapped = (p != NULL);
+	return p;
+}
+
+bool
+BayerRenderer::SetMappedBayer ()
+{
+	if (!pbo_mapped) {
+		return false;
+	}
+	glBindBufferARB (GL_PIXEL_UNPACK_BUFFER_ARB, pbo[pbo_next]);
+	glUnmapBufferARB (GL_PIXEL_UNPACK_BUFFER_ARB);
+	glBindBufferARB (GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+	pbo_mapped = false;
+
+	int previous = pbo_queued;
+	pbo_queued = pbo_next;
+	pbo_next = (pbo_next + 1) % UPLOAD_BUFFERS;
+	if (previous < 0) {
+		return false;
+	}
+	UploadBuffer (previous);
+	Render (NULL, 0);
+	return true;
+}
+
+bool
+BayerRenderer::FlushMappedBayer ()
+{
+	if (pbo_queued < 0) {
+		return false;
+	}
+	UploadBuffer (pbo_queued);
+	pbo_queued = -1;
+	Render (NULL, 0);
+	return true;
+}
+
+void
+BayerRenderer::SetReadback (ReadbackCallback callback,
+			    void *data)
+{
+	readback = callback;
+	readback_data = data;
+}
+
+bool
+BayerRenderer::ReadBack (int frame)
+{
+	if (readback == NULL || !GLEW_ARB_pixel_buffer_object || !GLEW_ARB_sync) {
+		return false;
+	}
+	if (pack[0] == 0) {
+		glGenBuffersARB (READBACK_BUFFERS, pack);
+		for (int i = 0; i < READBACK_BUFFERS; i++) {
+			glBindBufferARB (GL_PIXEL_PACK_BUFFER_ARB, pack[i]);
+			glBufferDataARB (GL_PIXEL_PACK_BUFFER_ARB, width * height * 3, NULL, GL_STREAM_READ_ARB);
+		}
+		glBindBufferARB (GL_PIXEL_PACK_BUFFER_ARB, 0);
+	}
+	if (readback_pending == READBACK_BUFFERS) {
+		DeliverReadback (true);
+	}
+
+	// Read into the buffer; glReadPixels returns as soon as the copy
+	// is queued.
+	rt->BeginCapture ();
+	GLint alignment;
+	glGetIntegerv (GL_PACK_ALIGNMENT, &alignment);
+	glPixelStorei (GL_PACK_ALIGNMENT, 1);
+	glBindBufferARB (GL_PIXEL_PACK_BUFFER_ARB, pack[readback_next]);
+	glReadPixels (0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+	glBindBufferARB (GL_PIXEL_PACK_BUFFER_ARB, 0);
+	glPixelStorei (GL_PACK_ALIGNMENT, alignment);
+	fences[readback_next] = glFenceSync (GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	rt->EndCapture ();
+
+	frames[readback_next] = frame;
+	readback_next = (readback_next + 1) % READBACK_BUFFERS;
+	readback_pending++;
+	PollReadback (false);
+	return true;
+}
+
+int
+BayerRenderer::PollReadback (bool wait)
+{
+	int delivered = 0;
+	while (readback_pending > 0 && DeliverReadback (wait)) {
+		delivered++;
+	}
+	return delivered;
+}
+
+bool
+BayerRenderer::DeliverReadback (bool wait)
+{
+	// Longest single wait, in nanoseconds.
+	static const GLuint64 TIMEOUT = 1000000000;
+	int i = (readback_next - readback_pending + READBACK_BUFFERS) % READBACK_BUFFERS;
+	GLenum status;
+
+	// The first wait flushes, so that the fence is sure to signal.
+	status = glClientWaitSync (fences[i], GL_SYNC_FLUSH_COMMANDS_BIT, wait ? TIMEOUT : 0);
+	while (wait && status == GL_TIMEOUT_EXPIRED) {
+		status = glClientWaitSync (fences[i], 0, TIMEOUT);
+	}
+	if (status == GL_TIMEOUT_EXPIRED) {
+		return false;
+	}
+	glDeleteSync (fences[i]);
+	readback_pending--;
+
+	glBindBufferARB (GL_PIXEL_PACK_BUFFER_ARB, pack[i]);
+	const GLubyte *rgb = static_cast<const GLubyte *>(glMapBufferARB (GL_PIXEL_PACK_BUFFER_ARB, GL_READ_ONLY_ARB));
+	if (rgb != NULL) {
+		if (readback != NULL) {
+			readback (rgb, frames[i], readback_data);
+		}
+		glUnmapBufferARB (GL_PIXEL_PACK_BUFFER_ARB);
+	}
+	glBindBufferARB (GL_PIXEL_PACK_BUFFER_ARB, 0);
+	return true;
+}
+
+void
+BayerRenderer::UploadBuffer (int i) const
+{
+	glBindBufferARB (GL_PIXEL_UNPACK_BUFFER_ARB, pbo[i]);
+	glBindTexture (GL_TEXTURE_RECTANGLE_NV, tex_bayer);
+	glTexSubImage2D (GL_TEXTURE_RECTANGLE_NV, 0, 0, 0, width, height, GL_LUMINANCE, GL_UNSIGNED_BYTE, NULL);
+	glBindBufferARB (GL_PIXEL_UNPACK_BUFFER_ARB, 0);
 }
 
 void
@@ -107,15 +301,21 @@ BayerRenderer::DisableTextureTarget () const
 	rt->DisableTextureTarget ();
 }
 
-RenderTexture*
+RenderTarget*
 BayerRenderer::CreateRenderTexture (int w,
 				    int h) const
 {
-	RenderTexture *rt  = new RenderTexture(RENDERTEXTURE_INIT);
+	RenderTarget *rt  = new RenderTarget (RENDERTEXTURE_INIT);
 	if (!rt->Initialize(w, h)) {
-		std::cerr << "ERROR: RenderTexture initialization failed" << std::endl;
+		std::cerr << "ERROR: render target initialization failed" << std::endl;
+		delete rt;
 		return NULL;
 	}
+	rt->Bind ();
+	glTexParameterf (rt->GetTextureTarget (), GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameterf (rt->GetTextureTarget (), GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameterf (rt->GetTextureTarget (), GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameterf (rt->GetTextureTarget (), GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	rt->BeginCapture ();
 	glViewport (0, 0, w, h);
 	glMatrixMode (GL_PROJECTION);
@@ -132,227 +332,176 @@ BayerRenderer::CreateRenderTexture (int w,
 void
 BayerRenderer::InitializeTextures ()
 {
-	glGenTextures (5, tex);
-
-	glBindTexture (GL_TEXTURE_RECTANGLE_NV, tex[BAYER]);
+	// Intensity, so that the second green can be drawn into alpha
+	glGenTextures (1, &tex_bayer);
+	glBindTexture (GL_TEXTURE_RECTANGLE_NV, tex_bayer);
 	glTexParameterf (GL_TEXTURE_RECTANGLE_NV, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 	glTexParameterf (GL_TEXTURE_RECTANGLE_NV, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 	glTexParameterf (GL_TEXTURE_RECTANGLE_NV, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 	glTexParameterf (GL_TEXTURE_RECTANGLE_NV, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexImage2D (GL_TEXTURE_RECTANGLE_NV, 0, 1, width, height, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, NULL);
+	glTexImage2D (GL_TEXTURE_RECTANGLE_NV, 0, GL_INTENSITY8, width, height, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, NULL);
+}
 
-	glBindTexture (GL_TEXTURE_RECTANGLE_NV, tex[RED]);
-	glTexParameterf (GL_TEXTURE_RECTANGLE_NV, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameterf (GL_TEXTURE_RECTANGLE_NV, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexParameterf (GL_TEXTURE_RECTANGLE_NV, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameterf (GL_TEXTURE_RECTANGLE_NV, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexImage2D (GL_TEXTURE_RECTANGLE_NV, 0, 4, width/2, height/2, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, NULL);
-	
-	glBindTexture (GL_TEXTURE_RECTANGLE_NV, tex[BLUE]);
-	glTexParameterf (GL_TEXTURE_RECTANGLE_NV, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameterf (GL_TEXTURE_RECTANGLE_NV, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexParameterf (GL_TEXTURE_RECTANGLE_NV, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameterf (GL_TEXTURE_RECTANGLE_NV, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexImage2D (GL_TEXTURE_RECTANGLE_NV, 0, 4, width/2, height/2, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, NULL);
-	
-	glBindTexture (GL_TEXTURE_RECTANGLE_NV, tex[GREEN1]);
-	glTexParameterf (GL_TEXTURE_RECTANGLE_NV, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameterf (GL_TEXTURE_RECTANGLE_NV, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexParameterf (GL_TEXTURE_RECTANGLE_NV, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameterf (GL_TEXTURE_RECTANGLE_NV, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexImage2D (GL_TEXTURE_RECTANGLE_NV, 0, 4, width/2, height/2, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, NULL);
-	
-	glBindTexture (GL_TEXTURE_RECTANGLE_NV, tex[GREEN2]);
-	glTexParameterf (GL_TEXTURE_RECTANGLE_NV, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameterf (GL_TEXTURE_RECTANGLE_NV, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexParameterf (GL_TEXTURE_RECTANGLE_NV, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameterf (GL_TEXTURE_RECTANGLE_NV, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexImage2D (GL_TEXTURE_RECTANGLE_NV, 0, 4, width/2, height/2, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, NULL);
+void
+BayerRenderer::Render (const Rect *rects,
+		       int count) const
+{
+	// Components of the packed texture each minified channel is drawn into
+	static const GLboolean MASKS[4][4] = {
+		{GL_TRUE, GL_FALSE, GL_FALSE, GL_FALSE},	// red
+		{GL_FALSE, GL_FALSE, GL_TRUE, GL_FALSE},	// blue
+		{GL_FALSE, GL_TRUE, GL_FALSE, GL_FALSE},	// green1
+		{GL_FALSE, GL_FALSE, GL_FALSE, GL_TRUE}		// green2
+	};
+	int box[4] = {0, 0, width, height};
+	int half[4] = {0, 0, width/2, height/2};
+
+	if (rects == NULL) {
+		count = 1;
+	}
+	for (int i = 0; i < count; i++) {
+		if (rects != NULL) {
+			// Pixels the rectangle can change, and the channel texels they read
+			box[0] = (rects[i].x > HALO) ? rects[i].x - HALO : 0;
+			box[1] = (rects[i].y > HALO) ? rects[i].y - HALO : 0;
+			box[2] = (rects[i].x + rects[i].width + HALO < width) ? rects[i].x + rects[i].width + HALO : width;
+			box[3] = (rects[i].y + rects[i].height + HALO < height) ? rects[i].y + rects[i].height + HALO : height;
+			half[0] = box[0] / 2;
+			half[1] = box[1] / 2;
+			half[2] = (box[2] + 1) / 2 < width/2 ? (box[2] + 1) / 2 : width/2;
+			half[3] = (box[3] + 1) / 2 < height/2 ? (box[3] + 1) / 2 : height/2;
+		}
+
+		// Render color channels straight into their components of
+		// the packed texture
+		channels->BeginCapture ();
+		if (rects != NULL) {
+			glEnable (GL_SCISSOR_TEST);
+			glScissor (half[0], half[1], half[2] - half[0], half[3] - half[1]);
+		}
+		glEnable (GL_TEXTURE_RECTANGLE_NV);
+		glBindTexture (GL_TEXTURE_RECTANGLE_NV, tex_bayer);
+		glTexEnvf (GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+		BindGeometry ();
+		for (int c = 0; c < 4; c++) {
+			glColorMask (MASKS[c][0], MASKS[c][1], MASKS[c][2], MASKS[c][3]);
+			glDrawArrays (GL_TRIANGLE_FAN, 4 * (QUAD_RED + c), 4);
+		}
+		glColorMask (GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+		UnbindGeometry ();
+		// Each pbuffer has a context of its own, which keeps the scissor
+		glDisable (GL_SCISSOR_TEST);
+		channels->EndCapture ();
+
+		// Render magnified and interpolated color channels: red and
+		// blue as they are, green interpolated between the packed
+		// green and the second green in alpha
+		rt->BeginCapture ();
+		if (rects != NULL) {
+			glEnable (GL_SCISSOR_TEST);
+			glScissor (box[0], box[1], box[2] - box[0], box[3] - box[1]);
+		}
+		channels->Bind ();
+		channels->EnableTextureTarget ();
+		glTexEnvfv (GL_TEXTURE_ENV, GL_TEXTURE_ENV_COLOR, BLEND);
+		glTexEnvf (GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_COMBINE);
+		glTexEnvf (GL_TEXTURE_ENV, GL_COMBINE_RGB, GL_INTERPOLATE);
+		glTexEnvf (GL_TEXTURE_ENV, GL_SOURCE0_RGB, GL_TEXTURE);
+		glTexEnvf (GL_TEXTURE_ENV, GL_OPERAND0_RGB, GL_SRC_COLOR);
+		glTexEnvf (GL_TEXTURE_ENV, GL_SOURCE1_RGB, GL_TEXTURE);
+		glTexEnvf (GL_TEXTURE_ENV, GL_OPERAND1_RGB, GL_SRC_ALPHA);
+		glTexEnvf (GL_TEXTURE_ENV, GL_SOURCE2_RGB, GL_CONSTANT);
+		glTexEnvf (GL_TEXTURE_ENV, GL_OPERAND2_RGB, GL_SRC_COLOR);
+		glTexEnvf (GL_TEXTURE_ENV, GL_COMBINE_ALPHA, GL_REPLACE);
+		glTexEnvf (GL_TEXTURE_ENV, GL_SOURCE0_ALPHA, GL_CONSTANT);
+		glTexEnvf (GL_TEXTURE_ENV, GL_OPERAND0_ALPHA, GL_SRC_ALPHA);
+		BindGeometry ();
+		glDrawArrays (GL_TRIANGLE_FAN, 4 * QUAD_MAG, 4);
+		UnbindGeometry ();
+		channels->DisableTextureTarget ();
+		glDisable (GL_SCISSOR_TEST);
+		rt->EndCapture ();
+	}
 }
 
 void
-BayerRenderer::Render () const
+BayerRenderer::InitializeGeometry ()
 {
-	// Render color channels into RenderTexture
-	rt->BeginCapture ();
-	glClear (GL_COLOR_BUFFER_BIT);
-	glEnable (GL_TEXTURE_RECTANGLE_NV);
-	glMatrixMode (GL_MODELVIEW);
-	glBindTexture (GL_TEXTURE_RECTANGLE_NV, tex[BAYER]);
-	glTexEnvf (GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
-	glCallList (texMinListRed);
-	glCallList (texMinListBlue);
-	glCallList (texMinListGreen1);
-	glCallList (texMinListGreen2);
-	glLoadIdentity ();
-	glColorMask (GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
-
-	// Copy from pbuffer into textures
-	glBindTexture (GL_TEXTURE_RECTANGLE_NV, tex[RED]);
-	glCopyTexSubImage2D (GL_TEXTURE_RECTANGLE_NV, 0, 0, 0, 0, 0, width/2, height/2);
-	glBindTexture (GL_TEXTURE_RECTANGLE_NV, tex[BLUE]);
-	glCopyTexSubImage2D (GL_TEXTURE_RECTANGLE_NV, 0, 0, 0, 0, height/2, width/2, height/2);
-	glBindTexture (GL_TEXTURE_RECTANGLE_NV, tex[GREEN1]);
-	glCopyTexSubImage2D (GL_TEXTURE_RECTANGLE_NV, 0, 0, 0, width/2, height/2, width/2, height/2);
-	glBindTexture (GL_TEXTURE_RECTANGLE_NV, tex[GREEN2]);
-	glCopyTexSubImage2D (GL_TEXTURE_RECTANGLE_NV, 0, 0, 0, width/2, 0, width/2, height/2);
-
-	// Render magnified and interpolated color channels
-	//glClear (GL_COLOR_BUFFER_BIT); // we overwrite same area, clear should not be necessary
-
-	// Set up green1
-	glActiveTexture (GL_TEXTURE0);
-	glBindTexture (GL_TEXTURE_RECTANGLE_NV, tex[GREEN1]);
-	glEnable (GL_TEXTURE_RECTANGLE_NV);
-	glTexEnvf (GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
-
-	// Set up green2
-	// Blend with green1
-	glActiveTexture (GL_TEXTURE1);
-	glBindTexture (GL_TEXTURE_RECTANGLE_NV, tex[GREEN2]);
-	glEnable (GL_TEXTURE_RECTANGLE_NV);
-	glTexEnvfv (GL_TEXTURE_ENV, GL_TEXTURE_ENV_COLOR, BLEND);
-	glTexEnvf (GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_COMBINE);
-	glTexEnvf (GL_TEXTURE_ENV, GL_COMBINE_RGB, GL_INTERPOLATE);
-	glTexEnvf (GL_TEXTURE_ENV, GL_SOURCE0_RGB, GL_PREVIOUS);
-	glTexEnvf (GL_TEXTURE_ENV, GL_OPERAND0_RGB, GL_SRC_COLOR);
-	glTexEnvf (GL_TEXTURE_ENV, GL_SOURCE1_RGB, GL_TEXTURE1);
-	glTexEnvf (GL_TEXTURE_ENV, GL_OPERAND1_RGB, GL_SRC_COLOR);
-	glTexEnvf (GL_TEXTURE_ENV, GL_SOURCE2_RGB, GL_CONSTANT);
-	glTexEnvf (GL_TEXTURE_ENV, GL_OPERAND2_RGB, GL_SRC_ALPHA);
-//      glTexEnvf (GL_TEXTURE_ENV, GL_COMBINE_ALPHA, GL_REPLACE);
-//	glTexEnvf (GL_TEXTURE_ENV, GL_SOURCE0_ALPHA, GL_PREVIOUS);
-//	glTexEnvf (GL_TEXTURE_ENV, GL_OPERAND0_ALPHA, GL_SRC_ALPHA);
-
-	// Set up red
-	glActiveTexture (GL_TEXTURE2);
-	glBindTexture (GL_TEXTURE_RECTANGLE_NV, tex[RED]);
-	glEnable (GL_TEXTURE_RECTANGLE_NV);
-	glTexEnvf (GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_ADD);
-
-	// Set up blue
-	glActiveTexture (GL_TEXTURE3);
-	glBindTexture (GL_TEXTURE_RECTANGLE_NV, tex[BLUE]);
-	glEnable (GL_TEXTURE_RECTANGLE_NV);
-	glTexEnvf (GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_ADD);
-
-	// Render all channels
-	glCallList (texMagList);
-
-	// Clean up
-	glActiveTexture (GL_TEXTURE3);
-	glDisable (GL_TEXTURE_RECTANGLE_NV);
-	glActiveTexture (GL_TEXTURE2);
-	glDisable (GL_TEXTURE_RECTANGLE_NV);
-	glActiveTexture (GL_TEXTURE1);
-	glDisable (GL_TEXTURE_RECTANGLE_NV);
-	glActiveTexture (GL_TEXTURE0);
-	glDisable (GL_TEXTURE_RECTANGLE_NV);
+	const int (*offsets[4])[2] = {&OFFSET_RED, &OFFSET_BLUE, &OFFSET_GREEN1, &OFFSET_GREEN2};
+	const GLfloat w = width;
+	const GLfloat h = height;
+	const GLfloat half_w = width/2;
+	const GLfloat half_h = height/2;
+	GLfloat quads[QUADS][4][4] = {
+		// Image, magnified from the quarter-size channels
+		{
+			{0, 0, 0, 0},
+			{w, 0, half_w, 0},
+			{w, h, half_w, half_h},
+			{0, h, 0, half_h}
+		}
+	};
+
+	// Channels, minified from the Bayer image, each shifted onto its
+	// sites
+	for (int c = 0; c < 4; c++) {
+		GLfloat s = OFFSET + (*offsets[c])[0];
+		GLfloat t = OFFSET + (*offsets[c])[1];
+		GLfloat quad[4][4] = {
+			{0, 0, s, t},
+			{half_w, 0, s + w, t},
+			{half_w, half_h, s + w, t + h},
+			{0, half_h, s, t + h}
+		};
+		memcpy (quads[QUAD_RED + c], quad, sizeof (quad));
+	}
 
-	rt->EndCapture ();
+	glGenBuffersARB (1, &vbo);
+	glBindBufferARB (GL_ARRAY_BUFFER_ARB, vbo);
+	glBufferDataARB (GL_ARRAY_BUFFER_ARB, sizeof (quads), quads, GL_STATIC_DRAW_ARB);
+
+#ifndef PBUFFER
+	// The vertex array object records the arrays, so that Render only
+	// binds it.
+	glGenVertexArrays (1, &vao);
+	glBindVertexArray (vao);
+	SetVertexArrays ();
+	glBindVertexArray (0);
+#endif
+	glBindBufferARB (GL_ARRAY_BUFFER_ARB, 0);
 }
 
 void
-BayerRenderer::CreateMagnificationDisplayList ()
+BayerRenderer::SetVertexArrays () const
 {
-	texMagList = glGenLists (1);
-	glNewList (texMagList, GL_COMPILE);
-	glBegin (GL_QUADS);
-
-	glMultiTexCoord2i (GL_TEXTURE0, 0, 0);
-	glMultiTexCoord2i (GL_TEXTURE1, 0, 0);
-	glMultiTexCoord2i (GL_TEXTURE2, 0, 0);
-	glMultiTexCoord2i (GL_TEXTURE3, 0, 0);
-	glVertex2i (0, 0);
-
-	glMultiTexCoord2i (GL_TEXTURE0, width/2, 0);
-	glMultiTexCoord2i (GL_TEXTURE1, width/2, 0);
-	glMultiTexCoord2i (GL_TEXTURE2, width/2, 0);
-	glMultiTexCoord2i (GL_TEXTURE3, width/2, 0);
-	glVertex2i (width, 0);
-	
-	glMultiTexCoord2i (GL_TEXTURE0, width/2, height/2);
-	glMultiTexCoord2i (GL_TEXTURE1, width/2, height/2);
-	glMultiTexCoord2i (GL_TEXTURE2, width/2, height/2);
-	glMultiTexCoord2i (GL_TEXTURE3, width/2, height/2);
-	glVertex2i (width, height);
-
-	glMultiTexCoord2i (GL_TEXTURE0, 0, height/2);
-	glMultiTexCoord2i (GL_TEXTURE1, 0, height/2);
-	glMultiTexCoord2i (GL_TEXTURE2, 0, height/2);
-	glMultiTexCoord2i (GL_TEXTURE3, 0, height/2);
-	glVertex2i (0, height);
-
-	glEnd();
-	glEndList ();
+	glVertexPointer (2, GL_FLOAT, 4 * sizeof (GLfloat), (const GLvoid *) 0);
+	glTexCoordPointer (2, GL_FLOAT, 4 * sizeof (GLfloat), (const GLvoid *) (2 * sizeof (GLfloat)));
+	glEnableClientState (GL_VERTEX_ARRAY);
+	glEnableClientState (GL_TEXTURE_COORD_ARRAY);
+}
+
+void
+BayerRenderer::BindGeometry () const
+{
+#ifdef PBUFFER
+	// Each pbuffer has a context of its own, and vertex array objects
+	// are not shared between contexts, unlike the buffer, so point the
+	// arrays at it in the current one.
+	glBindBufferARB (GL_ARRAY_BUFFER_ARB, vbo);
+	SetVertexArrays ();
+	glBindBufferARB (GL_ARRAY_BUFFER_ARB, 0);
+#else
+	glBindVertexArray (vao);
+#endif
 }
 
 void
-BayerRenderer::CreateMinificationDisplayLists ()
+BayerRenderer::UnbindGeometry () const
 {
-	texMinListMain   = glGenLists (5);
-	texMinListRed    = texMinListMain + 1;
-	texMinListBlue   = texMinListMain + 2;
-	texMinListGreen1 = texMinListMain + 3;
-	texMinListGreen2 = texMinListMain + 4;
-
-	// Draw quarter-size textured quad
-	glNewList (texMinListMain, GL_COMPILE);
-	glBegin (GL_QUADS);
-	glTexCoord2i (0, 0);          glVertex2i (0, 0);
-	glTexCoord2i (width, 0);      glVertex2i (width/2, 0);
-	glTexCoord2i (width, height); glVertex2i (width/2, height/2);
-	glTexCoord2i (0, height);     glVertex2i (0, height/2);
-	glEnd();
-	glLoadIdentity ();
-	glMatrixMode (GL_MODELVIEW);
-	glEndList ();
-
-	// Render color channels
-	//  --------
-	// | B | G1 |
-	// |---|----| 
-	// | R | G2 |
-	//  --------
-	// Note: need colormasks for multitexturing
-	// Red
-	glNewList (texMinListRed, GL_COMPILE);
-	glColorMask (GL_TRUE, GL_FALSE, GL_FALSE, GL_TRUE);
-	glLoadIdentity ();
-	glMatrixMode (GL_TEXTURE);
-	glLoadIdentity ();
-	glTranslatef (OFFSET + OFFSET_RED[0], OFFSET + OFFSET_RED[1], 0.0);
-	glCallList (texMinListMain);
-	glEndList ();
-
-	// Blue
-	glNewList (texMinListBlue, GL_COMPILE);
-	glColorMask (GL_FALSE, GL_FALSE, GL_TRUE, GL_TRUE);
-	glTranslatef (0.0, height/2, 0.0);
-	glMatrixMode (GL_TEXTURE);
-	glLoadIdentity ();
-	glTranslatef (OFFSET + OFFSET_BLUE[0], OFFSET + OFFSET_BLUE[1], 0.0);
-	glCallList (texMinListMain);
-	glEndList ();
-
-	// Green1
-	glNewList (texMinListGreen1, GL_COMPILE);
-	glColorMask (GL_FALSE, GL_TRUE, GL_FALSE, GL_TRUE);
-	glLoadIdentity ();
-	glTranslatef (width/2, height/2, 0.0);
-	glMatrixMode (GL_TEXTURE);
-	glLoadIdentity ();
-	glTranslatef (OFFSET + OFFSET_GREEN1[0], OFFSET + OFFSET_GREEN1[1], 0.0);
-	glCallList (texMinListMain);
-	glEndList ();
-
-	// Green2
-	glNewList (texMinListGreen2, GL_COMPILE);
-	glLoadIdentity ();
-	glTranslatef (width/2, 0.0, 0.0);
-	glMatrixMode (GL_TEXTURE);
-	glLoadIdentity ();
-	glTranslatef (OFFSET + OFFSET_GREEN2[0], OFFSET + OFFSET_GREEN2[1], 0.0);
-	glCallList (texMinListMain);
-	glEndList ();
+#ifdef PBUFFER
+	glDisableClientState (GL_VERTEX_ARRAY);
+	glDisableClientState (GL_TEXTURE_COORD_ARRAY);
+#else
+	glBindVertexArray (0);
+#endif
 }
@@ -7,7 +7,15 @@
 #ifndef BAYER_RENDERER_HPP
 #define BAYER_RENDERER_HPP
 
-#include "RenderTexture.h"
+#ifdef PBUFFER
+# include "RenderTexture.h"
+/// Render target: a pbuffer, with a context of its own.
+typedef RenderTexture RenderTarget;
+#else
+# include "FramebufferTexture.hpp"
+/// Render target: a framebuffer object in the current context.
+typedef FramebufferTexture RenderTarget;
+#endif
 
 /**
  * Bayer pattern image renderer.  Renders a Bayer pattern image in
@@ -15,6 +23,27 @@
  */
 class BayerRenderer {
 public:
+	/// Rectangle of the image, in pixels.
+	struct Rect {
+		int x;		///< Left column.
+		int y;		///< Bottom row.
+		int width;	///< Columns.
+		int height;	///< Rows.
+	};
+
+	/**
+	 * Receives a frame read back by ReadBack.  It must not call back
+	 * into the renderer.
+	 *
+	 * @param rgb	width x height RGB pixels, bottom row first, valid
+	 *		only during the call.
+	 * @param frame	the frame number given to ReadBack.
+	 * @param data	the pointer given to SetReadback.
+	 */
+	typedef void (*ReadbackCallback) (const GLubyte *rgb,
+					  int frame,
+					  void *data);
+
 	/** 
 	 * Constructor.
 	 */
@@ -47,6 +76,80 @@ public:
 	 * Updates Bayer texture from image data in memory and renders to texture.
 	 */
 	void SetBayer (const GLubyte *) const;
+
+	/**
+	 * Updates only the given rectangles of the Bayer texture, and
+	 * renders only the pixels whose colour they can change.  The
+	 * rest of the render target keeps the previous frame.
+	 *
+	 * @param bayer		the whole image.
+	 * @param rects		the changed rectangles, within the image.
+	 * @param count		the number of rectangles.
+	 */
+	void SetBayer (const GLubyte *bayer,
+		       const Rect *rects,
+		       int count) const;
+
+	/**
+	 * Maps the next pixel buffer of the upload ring, for the caller
+	 * to write a frame into directly instead of passing it to
+	 * SetBayer.  Hand it back with SetMappedBayer.
+	 *
+	 * @return	width x height bytes of write-only memory, or NULL if
+	 *		pixel buffer objects are not supported.
+	 */
+	GLubyte *MapBayer ();
+
+	/**
+	 * Unmaps the buffer returned by MapBayer and queues it.  The Bayer
+	 * texture is updated from the buffer queued by the previous call,
+	 * and that frame is rendered, so each transfer has a frame's time
+	 * to complete while the caller fills the next buffer.
+	 *
+	 * @return	true if a frame was rendered; false on the first call,
+	 *		or if no buffer is mapped.
+	 */
+	bool SetMappedBayer ();
+
+	/**
+	 * Updates the Bayer texture from the queued buffer, if any, and
+	 * renders it.  Call after the last SetMappedBayer.
+	 *
+	 * @return	true if a frame was rendered.
+	 */
+	bool FlushMappedBayer ();
+
+	/**
+	 * Sets the function that receives frames read back by ReadBack.
+	 *
+	 * @param callback	the function, or NULL.
+	 * @param data		passed on to it.
+	 */
+	void SetReadback (ReadbackCallback callback,
+			  void *data);
+
+	/**
+	 * Starts reading the rendered image back into a ring of pixel pack
+	 * buffers without waiting for it.  The frame is passed to the
+	 * readback callback once a fence shows the GPU has written it,
+	 * usually by a ReadBack or PollReadback a frame or two later.
+	 * When all #READBACK_BUFFERS are in flight, waits for the oldest.
+	 *
+	 * @param frame	a number passed on to the callback.
+	 *
+	 * @return	false if there is no callback, or pixel buffer
+	 *		objects or sync objects are not supported.
+	 */
+	bool ReadBack (int frame);
+
+	/**
+	 * Passes finished frames to the readback callback, oldest first.
+	 *
+	 * @param wait	wait for all frames in flight.
+	 *
+	 * @return	the number of frames passed on.
+	 */
+	int PollReadback (bool wait);
 	
 	/**
 	 * Binds the texture to the active texture unit.
@@ -92,17 +195,18 @@ public:
 	void SetHeight (int height);
 	
 private:
-	/// Required number of texture units.
-	static const int REQUIRED_TEXTURE_UNITS;
-
 	/// Texture offset for minification.
 	static const float OFFSET;
 
-	/// Blending constant for the two green channels.
+	/// Interpolation constant: red and blue as packed, green halfway
+	/// between the two greens, opaque.
 	static const float BLEND[4];
 
-	/// Initialization string for RenderTexture.
+	/// Initialization (mode) string for the render target.
 	static const char *RENDERTEXTURE_INIT;
+
+	/// Reach of a Bayer sample into the RGB image, in pixels.
+	static const int HALO;
 	
 	/// (x,y) pixel offsets for red channel in Bayer image.
 	static const int OFFSET_RED[2];
@@ -122,40 +226,95 @@ private:
 	/// Image Height.
 	int height;
 
-	/// Texture id constants.
-	enum {BAYER = 0, RED, BLUE, GREEN1, GREEN2};
+	/// Bayer texture.
+	GLuint tex_bayer;
 
-	/// Texture ids.
-	GLuint tex[5];
+	/// Quads in the vertex buffer: the magnified image, then each
+	/// channel minified.
+	enum {QUAD_MAG = 0, QUAD_RED, QUAD_BLUE, QUAD_GREEN1, QUAD_GREEN2, QUADS};
 
-	/// Display lists
-	GLuint texMagList;
-	GLuint texMinListMain;
-	GLuint texMinListRed;
-	GLuint texMinListBlue;
-	GLuint texMinListGreen1;
-	GLuint texMinListGreen2;
+	/// Quads, as triangle fans of (x, y, s, t) vertices, and the vertex
+	/// array object drawing them (not in -DPBUFFER builds).
+	GLuint vbo;
+	GLuint vao;
 	
-	/// RenderTexture
-	RenderTexture *rt;
+	/// Render target the image is converted into.
+	RenderTarget *rt;
+
+	/// Quarter-size render target holding the color channels, packed
+	/// as red, first green, blue, second green.
+	RenderTarget *channels;
+
+	/// Number of pixel buffers in the upload ring.
+	static const int UPLOAD_BUFFERS = 3;
+
+	/// Upload ring, created by the first MapBayer.
+	GLuint pbo[UPLOAD_BUFFERS];
+
+	/// Buffer MapBayer maps next.
+	int pbo_next;
+
+	/// Buffer waiting to be uploaded, or -1.
+	int pbo_queued;
+
+	/// True while pbo[pbo_next] is mapped.
+	bool pbo_mapped;
+
+	/// Number of pixel buffers in the readback ring.
+	static const int READBACK_BUFFERS = 3;
+
+	/// Readback ring, created by the first ReadBack.
+	GLuint pack[READBACK_BUFFERS];
+
+	/// Fences after the reads into each buffer, and their frame numbers.
+	GLsync fences[READBACK_BUFFERS];
+	int frames[READBACK_BUFFERS];
+
+	/// Buffer ReadBack uses next.
+	int readback_next;
+
+	/// Frames in flight, in the readback_pending buffers before
+	/// readback_next.
+	int readback_pending;
+
+	/// Readback callback and its data.
+	ReadbackCallback readback;
+	void *readback_data;
 
 private:
 	/** 
-	 * Creates and sets defaults for a RenderTexture object.
+	 * Creates and sets defaults for a render target.
 	 * 
-	 * @param w	width of the RenderTexture object.
-	 * @param h	height of the RenderTexture object.
+	 * @param w	width of the render target.
+	 * @param h	height of the render target.
 	 * 
-	 * @return	a pointer to the new RenderTexture object, or NULL on failure.
+	 * @return	a pointer to the new render target, or NULL on failure.
 	 */
-	RenderTexture* CreateRenderTexture (int w,
+	RenderTarget* CreateRenderTexture (int w,
 					    int h) const;
 
 	/** 
-	 * Sets texture parameters for all textures.
+	 * Creates the Bayer texture.
 	 */
 	void InitializeTextures ();
 
+	/**
+	 * Updates the Bayer texture from a buffer of the upload ring.
+	 *
+	 * @param i	the buffer.
+	 */
+	void UploadBuffer (int i) const;
+
+	/**
+	 * Passes the oldest frame in flight to the readback callback once
+	 * the GPU has written it.
+	 *
+	 * @param wait	wait for it.
+	 *
+	 * @return	true if it was passed on.
+	 */
+	bool DeliverReadback (bool wait);
+
 	/** 
 	 * Draws minified textured quad with specified texture offset.
 	 * 
@@ -172,18 +331,36 @@ private:
 
 	/** 
 	 * Performs conversion of Bayer image to RGB image.
+	 *
+	 * @param rects		rectangles to convert, grown by #HALO, or NULL
+	 *			to convert the whole image.
+	 * @param count		the number of rectangles.
+	 */
+	void Render (const Rect *rects,
+		     int count) const;
+
+	/** 
+	 * Creates the vertex buffer and vertex array object of the quads.
+	 */
+	void InitializeGeometry ();
+
+	/** 
+	 * Points the vertex and texture coordinate arrays at the bound
+	 * vertex buffer, and enables them.
 	 */
-	void Render () const;
+	void SetVertexArrays () const;
 
 	/** 
-	 * Creates display list for magnified textured quad.
+	 * Sets up the quads for drawing in the current context: binds the
+	 * vertex array object, or with -DPBUFFER, where it would belong to
+	 * another context, sets the arrays up again.
 	 */
-	void CreateMagnificationDisplayList ();
+	void BindGeometry () const;
 
 	/** 
-	 * Creates display lists for minified textured quads.
+	 * Undoes BindGeometry.
 	 */
-	void CreateMinificationDisplayLists ();
+	void UnbindGeometry () const;
 };
 
 inline int
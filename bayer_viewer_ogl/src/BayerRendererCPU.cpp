@@ -5,11 +5,15 @@
 
 #include <iostream>
 #include "BayerRendererCPU.hpp"
-#include "bayer.h"
 
 BayerRendererCPU::BayerRendererCPU () : width (0),
-					height (0)
+					height (0),
+					quality (NULL),
+					levels (0),
+					stream (NULL)
 {
+	gp_bayer_pipeline_init (&pipeline);
+	SetMethod (pipeline.method, pipeline.adaptive_threshold);
 }
 
 BayerRendererCPU::~BayerRendererCPU ()
@@ -17,6 +21,10 @@ BayerRendererCPU::~BayerRendererCPU ()
 	if (rgb != NULL) {
 		delete [] rgb;
 	}
+	if (quality != NULL) {
+		delete quality;
+	}
+	gp_bayer_stream_free (stream);
 	glDeleteTextures (1, &tex);
 }
 
@@ -49,11 +57,134 @@ BayerRendererCPU::Initialize (int w,
 
 void
 BayerRendererCPU::SetBayer (const GLubyte *bayer) const {
-	gp_bayer_decode (bayer, width, height, rgb, BAYER_TILE_GRBG);
+	BayerPipeline p = pipeline;
+	double start = QualityController::now ();
+
+	// Demosaic with the method the time budget allows.
+	p.method = GetMethod ();
+	if (stream != NULL) {
+		stream->adaptive_threshold = p.adaptive_threshold;
+		if (p.denoise == 0 && p.defects == NULL && p.shading == NULL &&
+		    p.stats == NULL && p.sharpen == 0.0f && p.pyramid == NULL &&
+		    gp_bayer_stream_decode (stream, bayer, p.method) == 0) {
+			if (quality != NULL) {
+				quality->update (QualityController::now () - start);
+			}
+			UploadDirty ();
+			return;
+		}
+		// The texture no longer holds the stream output.
+		gp_bayer_stream_reset (stream);
+	}
+	gp_bayer_decode_pipeline (bayer, width, height, rgb, BAYER_TILE_GRBG, &p);
+	if (quality != NULL) {
+		quality->update (QualityController::now () - start);
+	}
 	glBindTexture (GL_TEXTURE_RECTANGLE_NV, tex);
 	glTexSubImage2D (GL_TEXTURE_RECTANGLE_NV, 0, 0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, rgb);
 }
 
+void
+BayerRendererCPU::UploadDirty () const
+{
+	int tx, ty, end, x0, y0, x1, y1;
+
+	glBindTexture (GL_TEXTURE_RECTANGLE_NV, tex);
+	if (stream->dirty_count == stream->tiles_x * stream->tiles_y) {
+		glTexSubImage2D (GL_TEXTURE_RECTANGLE_NV, 0, 0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, stream->output);
+		return;
+	}
+
+	// One upload per run of dirty tiles along a row of tiles.
+	glPixelStorei (GL_UNPACK_ROW_LENGTH, width);
+	for (ty = 0; ty < stream->tiles_y; ty++) {
+		const unsigned char *dirty = stream->dirty + ty * stream->tiles_x;
+		for (tx = 0; tx < stream->tiles_x; tx = end) {
+			if (!dirty[tx]) {
+				end = tx + 1;
+				continue;
+			}
+			for (end = tx + 1; end < stream->tiles_x && dirty[end]; end++) {
+			}
+			x0 = tx * BAYER_STREAM_TILE_W;
+			y0 = ty * BAYER_STREAM_TILE_H;
+			x1 = (end * BAYER_STREAM_TILE_W > width) ? width : end * BAYER_STREAM_TILE_W;
+			y1 = (y0 + BAYER_STREAM_TILE_H > height) ? height : y0 + BAYER_STREAM_TILE_H;
+			glPixelStorei (GL_UNPACK_SKIP_PIXELS, x0);
+			glPixelStorei (GL_UNPACK_SKIP_ROWS, y0);
+			glTexSubImage2D (GL_TEXTURE_RECTANGLE_NV, 0, x0, y0, x1 - x0, y1 - y0,
+					 GL_RGB, GL_UNSIGNED_BYTE, stream->output);
+		}
+	}
+	glPixelStorei (GL_UNPACK_SKIP_PIXELS, 0);
+	glPixelStorei (GL_UNPACK_SKIP_ROWS, 0);
+	glPixelStorei (GL_UNPACK_ROW_LENGTH, 0);
+}
+
+void
+BayerRendererCPU::SetStream (bool enable,
+			     int threshold)
+{
+	if (!enable) {
+		gp_bayer_stream_free (stream);
+		stream = NULL;
+		return;
+	}
+	if (stream == NULL) {
+		stream = gp_bayer_stream_new (width, height, BAYER_TILE_GRBG);
+	}
+	stream->threshold = threshold;
+}
+
+void
+BayerRendererCPU::SetDeadline (double seconds)
+{
+	if (seconds <= 0.0) {
+		delete quality;
+		quality = NULL;
+	} else if (quality == NULL) {
+		quality = new QualityController (levels, seconds);
+	} else {
+		quality->set_budget (seconds);
+	}
+}
+
+void
+BayerRendererCPU::SetMethod (BayerMethod method,
+			     int threshold)
+{
+	pipeline.method = method;
+	pipeline.adaptive_threshold = threshold;
+
+	// Methods from best to fastest: this one, then whichever of
+	// bilinear and superpixel are cheaper, so every step down changes
+	// the method.
+	levels = 0;
+	methods[levels++] = method;
+	if (method != BAYER_METHOD_BILINEAR && method != BAYER_METHOD_SUPERPIXEL) {
+		methods[levels++] = BAYER_METHOD_BILINEAR;
+	}
+	if (method != BAYER_METHOD_SUPERPIXEL) {
+		methods[levels++] = BAYER_METHOD_SUPERPIXEL;
+	}
+
+	// The controller's levels and cost ratios no longer apply.
+	if (quality != NULL) {
+		double budget = quality->get_budget ();
+		delete quality;
+		quality = new QualityController (levels, budget);
+	}
+}
+
+BayerMethod
+BayerRendererCPU::GetMethod () const
+{
+	if (quality == NULL) {
+		return pipeline.method;
+	}
+	return methods[quality->get_level ()];
+}
+
 void
 BayerRendererCPU::Bind () const
 {
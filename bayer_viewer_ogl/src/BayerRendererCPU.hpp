@@ -8,6 +8,9 @@
 #define BAYER_RENDERER_CPU_HPP
 
 #include <GL/glew.h>
+#include "bayer_pipeline.h"
+#include "bayer_stream.h"
+#include "QualityController.hpp"
 
 /**
  * Bayer pattern image renderer using CPU.  Renders a Bayer pattern
@@ -90,6 +93,106 @@ public:
 	 * @param height	the image height.
 	 */
 	void SetHeight (int height);
+
+	/** 
+	 * Sets the statistics collector filled by each SetBayer call.
+	 * 
+	 * @param stats		the statistics, or NULL to disable collection.
+	 */
+	void SetStats (BayerStats *stats);
+
+	/** 
+	 * Gets the statistics collector.
+	 * 
+	 * @return	the statistics, or NULL if collection is disabled.
+	 */
+	BayerStats *GetStats () const;
+
+	/** 
+	 * Sets the defect map corrected by each SetBayer call.
+	 * 
+	 * @param defects	the defect map, or NULL to disable correction.
+	 */
+	void SetDefects (const BayerDefects *defects);
+
+	/** 
+	 * Sets the lens-shading gains applied by each SetBayer call.
+	 * 
+	 * @param shading	the shading grids, or NULL to disable correction.
+	 */
+	void SetShading (const BayerShading *shading);
+
+	/** 
+	 * Sets the strength of the CFA noise filter run by each SetBayer call.
+	 * 
+	 * @param threshold	the range threshold (see bayer_denoise.h), or 0
+	 *			to disable filtering.
+	 */
+	void SetDenoise (int threshold);
+
+	/** 
+	 * Sets the amount of sharpening applied by each SetBayer call.
+	 * 
+	 * @param amount	the unsharp-mask amount, or 0 to disable sharpening.
+	 */
+	void SetSharpen (float amount);
+
+	/** 
+	 * Sets the pyramid of reduced copies filled by each SetBayer call.
+	 * 
+	 * @param pyramid	the pyramid, for images of the renderer's size,
+	 *			or NULL to make none.
+	 */
+	void SetPyramid (BayerPyramid *pyramid);
+
+	/** 
+	 * Sets the interpolation method used by each SetBayer call.
+	 * 
+	 * @param method	the interpolation kernel (see bayer_pipeline.h).
+	 * @param threshold	for BAYER_METHOD_ADAPTIVE, the gradient energy
+	 *			above which a block uses the gradient kernel.
+	 */
+	void SetMethod (BayerMethod method, int threshold = BAYER_ADAPTIVE_THRESHOLD);
+
+	/** 
+	 * Sets the time budget for demosaicing in each SetBayer call.  While
+	 * decoding takes longer, the renderer steps down from the method set
+	 * with SetMethod to bilinear and then superpixel interpolation,
+	 * skipping either if it is that method already, and back up once
+	 * there is headroom again.
+	 * 
+	 * @param seconds	the budget, or 0 to always use the method set
+	 *			with SetMethod.
+	 */
+	void SetDeadline (double seconds);
+
+	/** 
+	 * Gets the interpolation method the next SetBayer call will use.
+	 * 
+	 * @return	the method.
+	 */
+	BayerMethod GetMethod () const;
+
+	/** 
+	 * Sets stream mode, for consecutive frames of a mostly static
+	 * scene.  Each SetBayer call then demosaics and uploads only the
+	 * tiles that changed since the previous frame, and their
+	 * neighbours.  Applies while no stages other than interpolation
+	 * are enabled and the method is not edge-directed; other frames
+	 * are decoded in full.  Call after Initialize.
+	 * 
+	 * @param enable	true to enable stream mode.
+	 * @param threshold	the largest sample difference between frames
+	 *			treated as unchanged.
+	 */
+	void SetStream (bool enable, int threshold = 0);
+
+	/** 
+	 * Gets the stream state.
+	 * 
+	 * @return	the stream, or NULL if stream mode is disabled.
+	 */
+	const BayerStream *GetStream () const;
 	
 private:
 	/// Image width.
@@ -104,11 +207,30 @@ private:
 	/// RGB image.
 	GLubyte *rgb;
 
+	/// Stages fused into demosaicing.
+	BayerPipeline pipeline;
+
+	/// Quality level for the time budget, or NULL without a budget.
+	QualityController *quality;
+
+	/// Methods for each quality level, from the one set with SetMethod
+	/// down to superpixel, without repeats.
+	BayerMethod methods[3];
+	int levels;
+
+	/// Previous frame and persistent output in stream mode, or NULL.
+	BayerStream *stream;
+
 private:
 	/** 
 	 * Sets texture parameters for all textures.
 	 */
 	void InitializeTextures ();
+
+	/** 
+	 * Uploads the tiles of the stream output rewritten by the last frame.
+	 */
+	void UploadDirty () const;
 };
 
 inline int
@@ -131,4 +253,44 @@ BayerRendererCPU::SetHeight (int h) {
 	height = h;
 }
 
+inline void
+BayerRendererCPU::SetStats (BayerStats *s) {
+	pipeline.stats = s;
+}
+
+inline BayerStats *
+BayerRendererCPU::GetStats () const {
+	return pipeline.stats;
+}
+
+inline void
+BayerRendererCPU::SetDefects (const BayerDefects *d) {
+	pipeline.defects = d;
+}
+
+inline void
+BayerRendererCPU::SetShading (const BayerShading *s) {
+	pipeline.shading = s;
+}
+
+inline void
+BayerRendererCPU::SetDenoise (int threshold) {
+	pipeline.denoise = threshold;
+}
+
+inline void
+BayerRendererCPU::SetSharpen (float amount) {
+	pipeline.sharpen = amount;
+}
+
+inline void
+BayerRendererCPU::SetPyramid (BayerPyramid *p) {
+	pipeline.pyramid = p;
+}
+
+inline const BayerStream *
+BayerRendererCPU::GetStream () const {
+	return stream;
+}
+
 #endif // BAYER_RENDERER_CPU_HPP
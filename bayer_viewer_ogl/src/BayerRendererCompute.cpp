@@ -0,0 +1,232 @@
+#include <cstdio>
+#include <iostream>
+#include "BayerRendererCompute.hpp"
+
+const int BayerRendererCompute::TILE = 16;
+const int BayerRendererCompute::HALO = 2;
+
+const char *BayerRendererCompute::METHOD_DEFINES[] =
+{
+	"#define BILINEAR\n",
+	"#define GRADIENT\n"
+};
+
+// TILE and HALO are defined ahead of the source.  Sites are G1 B / R G2,
+// bottom row first, the layout of bayerf.cg's MASK.
+const char *BayerRendererCompute::COMPUTE_SHADER =
+	"layout (local_size_x = TILE, local_size_y = TILE) in;\n"
+	"layout (binding = 0) uniform sampler2DRect bayer;\n"
+	"layout (binding = 0, rgba8) writeonly uniform image2DRect image;\n"
+	"layout (std430, binding = 0) writeonly buffer Output { uint rgba[]; };\n"
+	"uniform ivec2 size;\n"
+	"uniform bool to_buffer;\n"
+	"\n"
+	"#define SPAN (TILE + 2 * HALO)\n"
+	"shared float tile[SPAN][SPAN];\n"
+	"ivec2 l;\n"
+	"\n"
+	"float at (int dx, int dy)\n"
+	"{\n"
+	"	return tile[l.y + HALO + dy][l.x + HALO + dx];\n"
+	"}\n"
+	"\n"
+	"void main ()\n"
+	"{\n"
+	"	// Load the tile and its border, replicating the image edges.\n"
+	"	ivec2 origin = ivec2 (gl_WorkGroupID.xy) * TILE - HALO;\n"
+	"	for (int i = int (gl_LocalInvocationIndex); i < SPAN * SPAN; i += TILE * TILE) {\n"
+	"		ivec2 t = ivec2 (i % SPAN, i / SPAN);\n"
+	"		tile[t.y][t.x] = texelFetch (bayer, clamp (origin + t, ivec2 (0), size - 1)).r;\n"
+	"	}\n"
+	"	barrier ();\n"
+	"\n"
+	"	ivec2 p = ivec2 (gl_GlobalInvocationID.xy);\n"
+	"	if (any (greaterThanEqual (p, size)))\n"
+	"		return;\n"
+	"	l = ivec2 (gl_LocalInvocationID.xy);\n"
+	"\n"
+	"	float c = at (0, 0);\n"
+	"	float n = at (0, 1), s = at (0, -1), e = at (1, 0), w = at (-1, 0);\n"
+	"	float diagonal = at (1, 1) + at (-1, 1) + at (1, -1) + at (-1, -1);\n"
+	"#ifdef GRADIENT\n"
+	"	// Bilinear estimates corrected by the Laplacian of the centre\n"
+	"	// channel, as bayerhqf.cg.\n"
+	"	float n2 = at (0, 2), s2 = at (0, -2), e2 = at (2, 0), w2 = at (-2, 0);\n"
+	"	float distant = n2 + s2 + e2 + w2;\n"
+	"	float adjacent = (4.0 * c + 2.0 * (n + s + e + w) - distant) / 8.0;\n"
+	"	float opposite = (6.0 * c + 2.0 * diagonal - 1.5 * distant) / 8.0;\n"
+	"	float horizontal = (5.0 * c + 4.0 * (w + e) - w2 - e2 - diagonal + 0.5 * (n2 + s2)) / 8.0;\n"
+	"	float vertical = (5.0 * c + 4.0 * (n + s) - n2 - s2 - diagonal + 0.5 * (w2 + e2)) / 8.0;\n"
+	"#else\n"
+	"	float adjacent = 0.25 * (n + s + e + w);\n"
+	"	float opposite = 0.25 * diagonal;\n"
+	"	float horizontal = 0.5 * (w + e);\n"
+	"	float vertical = 0.5 * (n + s);\n"
+	"#endif\n"
+	"\n"
+	"	vec3 rgb;\n"
+	"	if ((p.y & 1) == 0)\n"
+	"		rgb = ((p.x & 1) == 0) ? vec3 (vertical, c, horizontal) : vec3 (opposite, adjacent, c);\n"
+	"	else\n"
+	"		rgb = ((p.x & 1) == 0) ? vec3 (c, adjacent, opposite) : vec3 (horizontal, c, vertical);\n"
+	"	rgb = clamp (rgb, 0.0, 1.0);\n"
+	"\n"
+	"	if (to_buffer)\n"
+	"		rgba[p.y * size.x + p.x] = packUnorm4x8 (vec4 (rgb, 1.0));\n"
+	"	else\n"
+	"		imageStore (image, p, vec4 (rgb, 1.0));\n"
+	"}\n";
+
+BayerRendererCompute::BayerRendererCompute () : width (0),
+						height (0),
+						tex_bayer (0),
+						tex_rgb (0),
+						method (METHOD_BILINEAR),
+						output (0)
+{
+	for (int i = 0; i < METHODS; i++) {
+		programs[i] = 0;
+		sizes[i] = -1;
+		to_buffers[i] = -1;
+	}
+}
+
+BayerRendererCompute::~BayerRendererCompute ()
+{
+	for (int i = 0; i < METHODS; i++) {
+		if (programs[i] != 0) {
+			glDeleteProgram (programs[i]);
+		}
+	}
+	if (tex_bayer != 0) {
+		glDeleteTextures (1, &tex_bayer);
+		glDeleteTextures (1, &tex_rgb);
+	}
+}
+
+bool
+BayerRendererCompute::Initialize (int w,
+				  int h)
+{
+	// Check for required extensions
+	if (!GLEW_VERSION_4_3) {
+		std::cerr << "ERROR: OpenGL 4.3 not supported" << std::endl;
+		return false;
+	}
+	width = w;
+	height = h;
+
+	for (int i = 0; i < METHODS; i++) {
+		programs[i] = CreateProgram (static_cast<Method>(i));
+		if (programs[i] == 0) {
+			return false;
+		}
+	}
+
+	// Set up textures
+	glGenTextures (1, &tex_bayer);
+	glBindTexture (GL_TEXTURE_RECTANGLE_NV, tex_bayer);
+	glTexParameteri (GL_TEXTURE_RECTANGLE_NV, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri (GL_TEXTURE_RECTANGLE_NV, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri (GL_TEXTURE_RECTANGLE_NV, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri (GL_TEXTURE_RECTANGLE_NV, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexImage2D (GL_TEXTURE_RECTANGLE_NV, 0, GL_R8, w, h, 0, GL_RED, GL_UNSIGNED_BYTE, NULL);
+
+	glGenTextures (1, &tex_rgb);
+	glBindTexture (GL_TEXTURE_RECTANGLE_NV, tex_rgb);
+	glTexParameteri (GL_TEXTURE_RECTANGLE_NV, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri (GL_TEXTURE_RECTANGLE_NV, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri (GL_TEXTURE_RECTANGLE_NV, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri (GL_TEXTURE_RECTANGLE_NV, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexImage2D (GL_TEXTURE_RECTANGLE_NV, 0, GL_RGBA8, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+
+	return true;
+}
+
+GLuint
+BayerRendererCompute::CreateProgram (Method m)
+{
+	char header[64];
+	const char *sources[3];
+	GLint status;
+	char log[1024];
+
+	snprintf (header, sizeof (header), "#version 430\n#define TILE %d\n#define HALO %d\n", TILE, HALO);
+	sources[0] = header;
+	sources[1] = METHOD_DEFINES[m];
+	sources[2] = COMPUTE_SHADER;
+
+	GLuint shader = glCreateShader (GL_COMPUTE_SHADER);
+	glShaderSource (shader, 3, sources, NULL);
+	glCompileShader (shader);
+	glGetShaderiv (shader, GL_COMPILE_STATUS, &status);
+	if (!status) {
+		glGetShaderInfoLog (shader, sizeof (log), NULL, log);
+		std::cerr << "ERROR: unable to compile compute shader\n" << log << std::endl;
+		glDeleteShader (shader);
+		return 0;
+	}
+
+	GLuint program = glCreateProgram ();
+	glAttachShader (program, shader);
+	glLinkProgram (program);
+	glDeleteShader (shader);
+	glGetProgramiv (program, GL_LINK_STATUS, &status);
+	if (!status) {
+		glGetProgramInfoLog (program, sizeof (log), NULL, log);
+		std::cerr << "ERROR: unable to link compute shader\n" << log << std::endl;
+		glDeleteProgram (program);
+		return 0;
+	}
+	sizes[m] = glGetUniformLocation (program, "size");
+	to_buffers[m] = glGetUniformLocation (program, "to_buffer");
+	return program;
+}
+
+void
+BayerRendererCompute::SetBayer (const GLubyte *bayer) const
+{
+	GLuint program = programs[method];
+
+	glPushAttrib (GL_TEXTURE_BIT);
+	glActiveTexture (GL_TEXTURE0);
+	glBindTexture (GL_TEXTURE_RECTANGLE_NV, tex_bayer);
+	glTexSubImage2D (GL_TEXTURE_RECTANGLE_NV, 0, 0, 0, width, height, GL_RED, GL_UNSIGNED_BYTE, bayer);
+
+	glUseProgram (program);
+	glUniform2i (sizes[method], width, height);
+	glUniform1i (to_buffers[method], output != 0);
+	glBindImageTexture (0, tex_rgb, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+	if (output != 0) {
+		glBindBufferBase (GL_SHADER_STORAGE_BUFFER, 0, output);
+	}
+	glDispatchCompute ((width + TILE - 1) / TILE, (height + TILE - 1) / TILE, 1);
+	if (output != 0) {
+		glBindBufferBase (GL_SHADER_STORAGE_BUFFER, 0, 0);
+	}
+	glUseProgram (0);
+	glPopAttrib ();
+
+	// The stores must land before the result is sampled or read
+	glMemoryBarrier (GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT |
+			 GL_PIXEL_BUFFER_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT |
+			 GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+void
+BayerRendererCompute::Bind () const
+{
+	glBindTexture (GL_TEXTURE_RECTANGLE_NV, tex_rgb);
+}
+
+void
+BayerRendererCompute::EnableTextureTarget () const
+{
+	glEnable (GL_TEXTURE_RECTANGLE_NV);
+}
+
+void
+BayerRendererCompute::DisableTextureTarget () const
+{
+	glDisable (GL_TEXTURE_RECTANGLE_NV);
+}
@@ -0,0 +1,193 @@
+/**
+ * @file   BayerRendererCompute.hpp
+ * @brief  Bayer pattern image renderer in compute shaders.
+ */
+
+#ifndef BAYER_RENDERER_COMPUTE_HPP
+#define BAYER_RENDERER_COMPUTE_HPP
+
+#include <GL/glew.h>
+
+/**
+ * Bayer pattern image renderer in compute shaders, for the G B / R G
+ * layout of bayer_cg's shaders.  Each workgroup loads its #TILE x #TILE
+ * pixels of the CFA and a #HALO wide border into shared memory once, and
+ * every invocation interpolates its pixel from there, so a sample is
+ * fetched about once instead of once per kernel tap.  That leaves the
+ * 5x5 gradient-corrected kernel of bayerhqf.cg (13 taps) little more
+ * expensive than bilinear (9 taps).  Edges are replicated, as
+ * GL_CLAMP_TO_EDGE does for the Cg shaders.
+ *
+ * The result goes to an RGBA rectangle texture, or with SetOutputBuffer
+ * straight into a shader storage buffer, one RGBA8 word per pixel, for
+ * readback or interop without a texture in between.
+ *
+ * Requires OpenGL 4.3 (compute shaders).
+ *
+ * USAGE:
+ *	BayerRendererCompute *br = new BayerRendererCompute ();
+ *	br->Initialize (width, height);
+ *	br->SetMethod (BayerRendererCompute::METHOD_GRADIENT);
+ *	br->SetBayer (bayer);
+ *	br->Bind ();		// RGBA rectangle texture
+ */
+class BayerRendererCompute {
+public:
+	/// Demosaicing algorithms.
+	enum Method {
+		METHOD_BILINEAR = 0,	///< Bilinear 3x3, as bayerf.cg.
+		METHOD_GRADIENT,	///< Gradient-corrected 5x5, as bayerhqf.cg.
+		METHODS
+	};
+
+	/**
+	 * Constructor.
+	 */
+	BayerRendererCompute ();
+
+	/**
+	 * Destructor.
+	 */
+	~BayerRendererCompute ();
+
+	/**
+	 * Initializes the renderer with specified image width and height.
+	 *
+	 * @param width		the image width.
+	 * @param height	the image height.
+	 *
+	 * @return	true on success, false otherwise.
+	 */
+	bool Initialize (int width,
+			 int height);
+
+	/**
+	 * Updates Bayer texture from image data in memory and demosaics it.
+	 *
+	 * @param bayer		width x height bytes, bottom row first.
+	 */
+	void SetBayer (const GLubyte *bayer) const;
+
+	/**
+	 * Sets the demosaicing algorithm used by SetBayer.
+	 *
+	 * @param method	the algorithm.
+	 */
+	void SetMethod (Method method);
+
+	/**
+	 * Gets the demosaicing algorithm used by SetBayer.
+	 *
+	 * @return	the algorithm.
+	 */
+	Method GetMethod () const;
+
+	/**
+	 * Directs output to a shader storage buffer instead of the texture.
+	 *
+	 * @param buffer	a buffer of at least width x height x 4 bytes,
+	 *			to hold RGBA8 pixels bottom row first, or 0 to
+	 *			write the texture again.
+	 */
+	void SetOutputBuffer (GLuint buffer);
+
+	/**
+	 * Binds the texture to the active texture unit.
+	 */
+	void Bind () const;
+
+	/**
+	 * Enables the texture target.
+	 */
+	void EnableTextureTarget () const;
+
+	/**
+	 * Disables the texture target.
+	 */
+	void DisableTextureTarget () const;
+
+	/**
+	 * Gets the image width.
+	 *
+	 * @return	the image width.
+	 */
+	int GetWidth () const;
+
+	/**
+	 * Gets the image height.
+	 *
+	 * @return	the image height.
+	 */
+	int GetHeight () const;
+
+private:
+	/// Workgroup size in pixels, along each side.
+	static const int TILE;
+
+	/// Kernel reach, the border loaded around each tile.
+	static const int HALO;
+
+	/// Compute shader source, and the defines selecting each method.
+	static const char *COMPUTE_SHADER;
+	static const char *METHOD_DEFINES[METHODS];
+
+	/// Image width.
+	int width;
+
+	/// Image height.
+	int height;
+
+	/// Bayer texture (R8) and output texture (RGBA8).
+	GLuint tex_bayer;
+	GLuint tex_rgb;
+
+	/// Programs, one per method, and the locations of their "size" and
+	/// "to_buffer" uniforms.
+	GLuint programs[METHODS];
+	GLint sizes[METHODS];
+	GLint to_buffers[METHODS];
+
+	/// Demosaicing algorithm.
+	Method method;
+
+	/// Output buffer, or 0.
+	GLuint output;
+
+private:
+	/**
+	 * Compiles and links the program for a method, printing the log on
+	 * failure, and looks up its uniforms.
+	 *
+	 * @param m	the method.
+	 *
+	 * @return	the program, or 0 on failure.
+	 */
+	GLuint CreateProgram (Method m);
+};
+
+inline int
+BayerRendererCompute::GetWidth () const {
+	return width;
+}
+
+inline int
+BayerRendererCompute::GetHeight () const {
+	return height;
+}
+
+inline void
+BayerRendererCompute::SetMethod (Method m) {
+	method = m;
+}
+
+inline BayerRendererCompute::Method
+BayerRendererCompute::GetMethod () const {
+	return method;
+}
+
+inline void
+BayerRendererCompute::SetOutputBuffer (GLuint buffer) {
+	output = buffer;
+}
+
+#endif // BAYER_RENDERER_COMPUTE_HPP
@@ -0,0 +1,265 @@
+#include <iostream>
+#include "BayerRendererGLSL.hpp"
+
+const char *BayerRendererGLSL::VERTEX_SHADER =
+	"#version 420\n"
+	"void main ()\n"
+	"{\n"
+	"	// One triangle covering the viewport.\n"
+	"	gl_Position = vec4 ((gl_VertexID & 1) * 4 - 1, (gl_VertexID >> 1) * 4 - 1, 0, 1);\n"
+	"}\n";
+
+// Quad components: x = (0,0), y = (1,0), z = (0,1), w = (1,1), which
+// are G1 B / R G2 bottom row first, the layout of bayerf.cg's MASK.
+const char *BayerRendererGLSL::FRAGMENT_SHADER =
+	"#version 420\n"
+	"layout (binding = 0) uniform sampler2DRect quads;\n"
+	"layout (binding = 0, rgba8) writeonly uniform image2DRect image;\n"
+	"uniform ivec2 last;	// last quad\n"
+	"\n"
+	"// Four pixels of one row of the window around the quad, from quad\n"
+	"// row upper of the quads left, centre and right of it; the window\n"
+	"// is one pixel wider on each side, replicating the image edge.\n"
+	"vec4 row (vec4 l, vec4 c, vec4 r, bool upper, bool left, bool right)\n"
+	"{\n"
+	"	vec2 L = upper ? l.zw : l.xy;\n"
+	"	vec2 C = upper ? c.zw : c.xy;\n"
+	"	vec2 R = upper ? r.zw : r.xy;\n"
+	"	return vec4 (left ? L.y : C.x, C.x, C.y, right ? R.x : C.y);\n"
+	"}\n"
+	"\n"
+	"void main ()\n"
+	"{\n"
+	"	ivec2 q = ivec2 (gl_FragCoord.xy);\n"
+	"	ivec2 lo = max (q - 1, 0);\n"
+	"	ivec2 hi = min (q + 1, last);\n"
+	"	bool left = q.x > 0;\n"
+	"	bool right = q.x < last.x;\n"
+	"\n"
+	"	vec4 sw = texelFetch (quads, lo);\n"
+	"	vec4 s  = texelFetch (quads, ivec2 (q.x, lo.y));\n"
+	"	vec4 se = texelFetch (quads, ivec2 (hi.x, lo.y));\n"
+	"	vec4 w  = texelFetch (quads, ivec2 (lo.x, q.y));\n"
+	"	vec4 c  = texelFetch (quads, q);\n"
+	"	vec4 e  = texelFetch (quads, ivec2 (hi.x, q.y));\n"
+	"	vec4 nw = texelFetch (quads, ivec2 (lo.x, hi.y));\n"
+	"	vec4 n  = texelFetch (quads, ivec2 (q.x, hi.y));\n"
+	"	vec4 ne = texelFetch (quads, hi);\n"
+	"\n"
+	"	// Rows 2q.y - 1 to 2q.y + 2, columns 2q.x - 1 to 2q.x + 2.\n"
+	"	vec4 r0 = (q.y > 0) ? row (sw, s, se, true, left, right) : row (w, c, e, false, left, right);\n"
+	"	vec4 r1 = row (w, c, e, false, left, right);\n"
+	"	vec4 r2 = row (w, c, e, true, left, right);\n"
+	"	vec4 r3 = (q.y < last.y) ? row (nw, n, ne, false, left, right) : row (w, c, e, true, left, right);\n"
+	"\n"
+	"	ivec2 p = 2 * q;\n"
+	"	// G1: red above and below, blue left and right.\n"
+	"	imageStore (image, p, vec4 (0.5 * (r0.y + r2.y), r1.y, 0.5 * (r1.x + r1.z), 1));\n"
+	"	// B.\n"
+	"	imageStore (image, p + ivec2 (1, 0),\n"
+	"		    vec4 (0.25 * (r0.y + r0.w + r2.y + r2.w),\n"
+	"			  0.25 * (r0.z + r2.z + r1.y + r1.w), r1.z, 1));\n"
+	"	// R.\n"
+	"	imageStore (image, p + ivec2 (0, 1),\n"
+	"		    vec4 (r2.y, 0.25 * (r1.y + r3.y + r2.x + r2.z),\n"
+	"			  0.25 * (r1.x + r1.z + r3.x + r3.z), 1));\n"
+	"	// G2: red left and right, blue above and below.\n"
+	"	imageStore (image, p + ivec2 (1, 1), vec4 (0.5 * (r2.y + r2.w), r2.z, 0.5 * (r1.z + r3.z), 1));\n"
+	"}\n";
+
+BayerRendererGLSL::BayerRendererGLSL () : width (0),
+					  height (0),
+					  tex_quads (0),
+					  tex_rgb (0),
+					  fbo (0),
+					  rb (0),
+					  program (0),
+					  last (-1),
+					  packed (NULL)
+{
+}
+
+BayerRendererGLSL::~BayerRendererGLSL ()
+{
+	if (program != 0) {
+		glDeleteProgram (program);
+	}
+	if (fbo != 0) {
+		glDeleteFramebuffersEXT (1, &fbo);
+		glDeleteRenderbuffersEXT (1, &rb);
+	}
+	if (tex_quads != 0) {
+		glDeleteTextures (1, &tex_quads);
+		glDeleteTextures (1, &tex_rgb);
+	}
+	delete [] packed;
+}
+
+bool
+BayerRendererGLSL::Initialize (int w,
+			       int h)
+{
+	// Check for required extensions
+	if (!GLEW_VERSION_4_2) {
+		std::cerr << "ERROR: OpenGL 4.2 not supported" << std::endl;
+		return false;
+	}
+	if (!GLEW_EXT_framebuffer_object) {
+		std::cerr << "ERROR: GL_EXT_framebuffer_object not supported" << std::endl;
+		return false;
+	}
+	if (w < 2 || h < 2 || w % 2 != 0 || h % 2 != 0) {
+		std::cerr << "ERROR: image dimensions must be even" << std::endl;
+		return false;
+	}
+	width = w;
+	height = h;
+
+	// Compile and link the program
+	GLuint vs = CompileShader (GL_VERTEX_SHADER, VERTEX_SHADER);
+	GLuint fs = CompileShader (GL_FRAGMENT_SHADER, FRAGMENT_SHADER);
+	if (vs == 0 || fs == 0) {
+		glDeleteShader (vs);
+		glDeleteShader (fs);
+		return false;
+	}
+	program = glCreateProgram ();
+	glAttachShader (program, vs);
+	glAttachShader (program, fs);
+	glLinkProgram (program);
+	glDeleteShader (vs);
+	glDeleteShader (fs);
+	GLint status;
+	glGetProgramiv (program, GL_LINK_STATUS, &status);
+	if (!status) {
+		char log[1024];
+		glGetProgramInfoLog (program, sizeof (log), NULL, log);
+		std::cerr << "ERROR: unable to link GLSL program\n" << log << std::endl;
+		return false;
+	}
+	last = glGetUniformLocation (program, "last");
+
+	// Set up textures
+	glGenTextures (1, &tex_quads);
+	glBindTexture (GL_TEXTURE_RECTANGLE_NV, tex_quads);
+	glTexParameteri (GL_TEXTURE_RECTANGLE_NV, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri (GL_TEXTURE_RECTANGLE_NV, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri (GL_TEXTURE_RECTANGLE_NV, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri (GL_TEXTURE_RECTANGLE_NV, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexImage2D (GL_TEXTURE_RECTANGLE_NV, 0, GL_RGBA8, w/2, h/2, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+
+	glGenTextures (1, &tex_rgb);
+	glBindTexture (GL_TEXTURE_RECTANGLE_NV, tex_rgb);
+	glTexParameteri (GL_TEXTURE_RECTANGLE_NV, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri (GL_TEXTURE_RECTANGLE_NV, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri (GL_TEXTURE_RECTANGLE_NV, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri (GL_TEXTURE_RECTANGLE_NV, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexImage2D (GL_TEXTURE_RECTANGLE_NV, 0, GL_RGBA8, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+
+	// One fragment per quad
+	GLint previous;
+	glGetIntegerv (GL_FRAMEBUFFER_BINDING_EXT, &previous);
+	glGenRenderbuffersEXT (1, &rb);
+	glBindRenderbufferEXT (GL_RENDERBUFFER_EXT, rb);
+	glRenderbufferStorageEXT (GL_RENDERBUFFER_EXT, GL_R8, w/2, h/2);
+	glGenFramebuffersEXT (1, &fbo);
+	glBindFramebufferEXT (GL_FRAMEBUFFER_EXT, fbo);
+	glFramebufferRenderbufferEXT (GL_FRAMEBUFFER_EXT, GL_COLOR_ATTACHMENT0_EXT, GL_RENDERBUFFER_EXT, rb);
+	GLenum fb_status = glCheckFramebufferStatusEXT (GL_FRAMEBUFFER_EXT);
+	glBindFramebufferEXT (GL_FRAMEBUFFER_EXT, previous);
+	if (fb_status != GL_FRAMEBUFFER_COMPLETE_EXT) {
+		std::cerr << "ERROR: framebuffer object incomplete (0x" << std::hex << fb_status << std::dec << ")" << std::endl;
+		return false;
+	}
+
+	packed = new GLubyte[w * h];
+	return true;
+}
+
+GLuint
+BayerRendererGLSL::CompileShader (GLenum type,
+				  const char *source)
+{
+	GLuint shader = glCreateShader (type);
+	GLint status;
+
+	glShaderSource (shader, 1, &source, NULL);
+	glCompileShader (shader);
+	glGetShaderiv (shader, GL_COMPILE_STATUS, &status);
+	if (!status) {
+		char log[1024];
+		glGetShaderInfoLog (shader, sizeof (log), NULL, log);
+		std::cerr << "ERROR: unable to compile GLSL shader\n" << log << std::endl;
+		glDeleteShader (shader);
+		return 0;
+	}
+	return shader;
+}
+
+void
+BayerRendererGLSL::SetBayer (const GLubyte *bayer)
+{
+	// Pack each pair of rows into quads
+	for (int y = 0; y < height; y += 2) {
+		const GLubyte *a = bayer + y * width;
+		const GLubyte *b = a + width;
+		GLubyte *q = packed + y * width;
+		for (int x = 0; x < width; x += 2, q += 4) {
+			q[0] = a[x];
+			q[1] = a[x + 1];
+			q[2] = b[x];
+			q[3] = b[x + 1];
+		}
+	}
+	GLint alignment;
+	glGetIntegerv (GL_UNPACK_ALIGNMENT, &alignment);
+	glPixelStorei (GL_UNPACK_ALIGNMENT, 4);
+	glBindTexture (GL_TEXTURE_RECTANGLE_NV, tex_quads);
+	glTexSubImage2D (GL_TEXTURE_RECTANGLE_NV, 0, 0, 0, width/2, height/2, GL_RGBA, GL_UNSIGNED_BYTE, packed);
+	glPixelStorei (GL_UNPACK_ALIGNMENT, alignment);
+	Render ();
+}
+
+void
+BayerRendererGLSL::Render () const
+{
+	GLint previous;
+	glGetIntegerv (GL_FRAMEBUFFER_BINDING_EXT, &previous);
+	glPushAttrib (GL_VIEWPORT_BIT | GL_COLOR_BUFFER_BIT | GL_TEXTURE_BIT);
+	glBindFramebufferEXT (GL_FRAMEBUFFER_EXT, fbo);
+	glViewport (0, 0, width/2, height/2);
+	glColorMask (GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+
+	glUseProgram (program);
+	glUniform2i (last, width/2 - 1, height/2 - 1);
+	glActiveTexture (GL_TEXTURE0);
+	glBindTexture (GL_TEXTURE_RECTANGLE_NV, tex_quads);
+	glBindImageTexture (0, tex_rgb, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+	glDrawArrays (GL_TRIANGLES, 0, 3);
+	glUseProgram (0);
+
+	// The stores must land before the texture is sampled or read
+	glMemoryBarrier (GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT |
+			 GL_PIXEL_BUFFER_BARRIER_BIT | GL_FRAMEBUFFER_BARRIER_BIT);
+
+	glBindFramebufferEXT (GL_FRAMEBUFFER_EXT, previous);
+	glPopAttrib ();
+}
+
+void
+BayerRendererGLSL::Bind () const
+{
+	glBindTexture (GL_TEXTURE_RECTANGLE_NV, tex_rgb);
+}
+
+void
+BayerRendererGLSL::EnableTextureTarget () const
+{
+	glEnable (GL_TEXTURE_RECTANGLE_NV);
+}
+
+void
+BayerRendererGLSL::DisableTextureTarget () const
+{
+	glDisable (GL_TEXTURE_RECTANGLE_NV);
+}
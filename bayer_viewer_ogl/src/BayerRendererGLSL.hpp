@@ -0,0 +1,147 @@
+/**
+ * @file   BayerRendererGLSL.hpp
+ * @brief  Bayer pattern image renderer in GLSL, on packed 2x2 quads.
+ */
+
+#ifndef BAYER_RENDERER_GLSL_HPP
+#define BAYER_RENDERER_GLSL_HPP
+
+#include <GL/glew.h>
+
+/**
+ * Bayer pattern image renderer in GLSL.  The bilinear demosaicing of
+ * bayer_cg's bayerf.cg, for the same G B / R G layout, without the Cg
+ * runtime.
+ *
+ * The CFA is uploaded as a w/2 x h/2 RGBA texture, one texel per 2x2
+ * quad, so each component always holds the same colour and no mask is
+ * needed.  The shader runs once per quad: it fetches the 3x3 quads
+ * around it and stores all four output pixels with imageStore, nine
+ * fetches for four pixels where bayerf.cg makes ten per pixel, and no
+ * interpolated texture coordinates.  Edges are replicated per pixel,
+ * as GL_CLAMP_TO_EDGE does for bayerf.cg.
+ *
+ * Requires OpenGL 4.2 (image load/store) and even image dimensions.
+ *
+ * USAGE:
+ *	BayerRendererGLSL *br = new BayerRendererGLSL ();
+ *	br->Initialize (width, height);
+ *	br->SetBayer (bayer);
+ *	br->Bind ();		// RGBA rectangle texture
+ */
+class BayerRendererGLSL {
+public:
+	/**
+	 * Constructor.
+	 */
+	BayerRendererGLSL ();
+
+	/**
+	 * Destructor.
+	 */
+	~BayerRendererGLSL ();
+
+	/**
+	 * Initializes the renderer with specified image width and height.
+	 *
+	 * @param width		the image width, even.
+	 * @param height	the image height, even.
+	 *
+	 * @return	true on success, false otherwise.
+	 */
+	bool Initialize (int width,
+			 int height);
+
+	/**
+	 * Updates the quad texture from image data in memory and renders
+	 * to texture.
+	 *
+	 * @param bayer		width x height bytes, bottom row first.
+	 */
+	void SetBayer (const GLubyte *bayer);
+
+	/**
+	 * Binds the texture to the active texture unit.
+	 */
+	void Bind () const;
+
+	/**
+	 * Enables the texture target.
+	 */
+	void EnableTextureTarget () const;
+
+	/**
+	 * Disables the texture target.
+	 */
+	void DisableTextureTarget () const;
+
+	/**
+	 * Gets the image width.
+	 *
+	 * @return	the image width.
+	 */
+	int GetWidth () const;
+
+	/**
+	 * Gets the image height.
+	 *
+	 * @return	the image height.
+	 */
+	int GetHeight () const;
+
+private:
+	/// Vertex and fragment shader sources.
+	static const char *VERTEX_SHADER;
+	static const char *FRAGMENT_SHADER;
+
+	/// Image width.
+	int width;
+
+	/// Image height.
+	int height;
+
+	/// Quad texture (w/2 x h/2 RGBA) and output texture (w x h RGBA).
+	GLuint tex_quads;
+	GLuint tex_rgb;
+
+	/// Quarter-size framebuffer the quads are rasterized into.  Its
+	/// colour buffer is never written.
+	GLuint fbo;
+	GLuint rb;
+
+	/// Shader program, and the location of its "last" uniform.
+	GLuint program;
+	GLint last;
+
+	/// Quads packed from the last frame, for upload.
+	GLubyte *packed;
+
+private:
+	/**
+	 * Compiles a shader, printing its log on failure.
+	 *
+	 * @param type		GL_VERTEX_SHADER or GL_FRAGMENT_SHADER.
+	 * @param source	the source.
+	 *
+	 * @return	the shader, or 0 on failure.
+	 */
+	static GLuint CompileShader (GLenum type,
+				     const char *source);
+
+	/**
+	 * Renders the quad texture into the output texture.
+	 */
+	void Render () const;
+};
+
+inline int
+BayerRendererGLSL::GetWidth () const {
+	return width;
+}
+
+inline int
+BayerRendererGLSL::GetHeight () const {
+	return height;
+}
+
+#endif // BAYER_RENDERER_GLSL_HPP
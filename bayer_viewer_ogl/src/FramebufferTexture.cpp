@@ -0,0 +1,124 @@
+#include <cstring>
+#include <iostream>
+#include "FramebufferTexture.hpp"
+
+static const GLfloat IDENTITY[16] =
+{
+	1, 0, 0, 0,
+	0, 1, 0, 0,
+	0, 0, 1, 0,
+	0, 0, 0, 1
+};
+
+FramebufferTexture::FramebufferTexture (const char *mode) :
+	target (strstr (mode, "texRECT") != NULL ? GL_TEXTURE_RECTANGLE_NV : GL_TEXTURE_2D),
+	format (strstr (mode, "rgba") != NULL ? GL_RGBA8 : GL_RGB8),
+	width (0),
+	height (0),
+	tex (0),
+	fbo (0),
+	previous (0),
+	matrix_mode (GL_MODELVIEW)
+{
+	memcpy (projection, IDENTITY, sizeof (IDENTITY));
+	memcpy (modelview, IDENTITY, sizeof (IDENTITY));
+	memcpy (texture, IDENTITY, sizeof (IDENTITY));
+	clear[0] = clear[1] = clear[2] = clear[3] = 0.0;
+}
+
+FramebufferTexture::~FramebufferTexture ()
+{
+	if (fbo != 0) {
+		glDeleteFramebuffersEXT (1, &fbo);
+	}
+	if (tex != 0) {
+		glDeleteTextures (1, &tex);
+	}
+}
+
+bool
+FramebufferTexture::Initialize (int w,
+				int h)
+{
+	if (!GLEW_EXT_framebuffer_object) {
+		std::cerr << "ERROR: GL_EXT_framebuffer_object not supported" << std::endl;
+		return false;
+	}
+	width = w;
+	height = h;
+	viewport[0] = viewport[1] = 0;
+	viewport[2] = w;
+	viewport[3] = h;
+
+	glGenTextures (1, &tex);
+	glBindTexture (target, tex);
+	glTexParameteri (target, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri (target, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexImage2D (target, 0, format, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+
+	glGetIntegerv (GL_FRAMEBUFFER_BINDING_EXT, &previous);
+	glGenFramebuffersEXT (1, &fbo);
+	glBindFramebufferEXT (GL_FRAMEBUFFER_EXT, fbo);
+	glFramebufferTexture2DEXT (GL_FRAMEBUFFER_EXT, GL_COLOR_ATTACHMENT0_EXT, target, tex, 0);
+	GLenum status = glCheckFramebufferStatusEXT (GL_FRAMEBUFFER_EXT);
+	glBindFramebufferEXT (GL_FRAMEBUFFER_EXT, previous);
+	if (status != GL_FRAMEBUFFER_COMPLETE_EXT) {
+		std::cerr << "ERROR: framebuffer object incomplete (0x" << std::hex << status << std::dec << ")" << std::endl;
+		glDeleteFramebuffersEXT (1, &fbo);
+		fbo = 0;
+		return false;
+	}
+	return true;
+}
+
+bool
+FramebufferTexture::BeginCapture ()
+{
+	if (fbo == 0) {
+		return false;
+	}
+	glGetIntegerv (GL_FRAMEBUFFER_BINDING_EXT, &previous);
+	glPushAttrib (GL_VIEWPORT_BIT | GL_COLOR_BUFFER_BIT | GL_ENABLE_BIT |
+		      GL_SCISSOR_BIT | GL_TEXTURE_BIT | GL_TRANSFORM_BIT);
+	glActiveTexture (GL_TEXTURE0);
+	glMatrixMode (GL_TEXTURE);
+	glPushMatrix ();
+	glLoadMatrixf (texture);
+	glMatrixMode (GL_PROJECTION);
+	glPushMatrix ();
+	glLoadMatrixf (projection);
+	glMatrixMode (GL_MODELVIEW);
+	glPushMatrix ();
+	glLoadMatrixf (modelview);
+	glMatrixMode (matrix_mode);
+
+	glBindFramebufferEXT (GL_FRAMEBUFFER_EXT, fbo);
+	glViewport (viewport[0], viewport[1], viewport[2], viewport[3]);
+	glClearColor (clear[0], clear[1], clear[2], clear[3]);
+	return true;
+}
+
+bool
+FramebufferTexture::EndCapture ()
+{
+	if (fbo == 0) {
+		return false;
+	}
+	glGetIntegerv (GL_VIEWPORT, viewport);
+	glGetFloatv (GL_COLOR_CLEAR_VALUE, clear);
+	glGetIntegerv (GL_MATRIX_MODE, &matrix_mode);
+	glGetFloatv (GL_PROJECTION_MATRIX, projection);
+	glGetFloatv (GL_MODELVIEW_MATRIX, modelview);
+	glActiveTexture (GL_TEXTURE0);
+	glGetFloatv (GL_TEXTURE_MATRIX, texture);
+
+	glBindFramebufferEXT (GL_FRAMEBUFFER_EXT, previous);
+	glMatrixMode (GL_TEXTURE);
+	glPopMatrix ();
+	glMatrixMode (GL_PROJECTION);
+	glPopMatrix ();
+	glMatrixMode (GL_MODELVIEW);
+	glPopMatrix ();
+	glPopAttrib ();
+	return true;
+}
@@ -0,0 +1,166 @@
+/**
+ * @file   FramebufferTexture.hpp
+ * @brief  Render-to-texture through a framebuffer object.
+ */
+
+#ifndef FRAMEBUFFERTEXTURE_HPP
+#define FRAMEBUFFERTEXTURE_HPP
+
+#include <GL/glew.h>
+
+/**
+ * Render-to-texture through a framebuffer object
+ * (GL_EXT_framebuffer_object).  A drop-in for the parts of RenderTexture
+ * the renderers use: rendering between BeginCapture and EndCapture goes
+ * straight into the texture, in the current context, with no context
+ * switch and no copy.
+ *
+ * A pbuffer has a context of its own, so the renderers set up its
+ * viewport and matrices once.  To keep that working, the viewport, the
+ * projection, modelview and texture matrices, the clear colour and the
+ * matrix mode set during a capture are kept for the next one, and the
+ * caller's are restored by EndCapture, along with the enables, colour
+ * mask, scissor and texture state.
+ *
+ * USAGE:
+ *	FramebufferTexture *rt = new FramebufferTexture ("rgba texRECT");
+ *	rt->Initialize (width, height);
+ *	rt->BeginCapture ();
+ *	// draw
+ *	rt->EndCapture ();
+ *	rt->Bind ();
+ */
+class FramebufferTexture
+{
+public:
+	/**
+	 * Constructor.
+	 *
+	 * @param mode	the RenderTexture mode string: "rgb" or "rgba",
+	 *		and "texRECT" for a rectangle texture.
+	 */
+	FramebufferTexture (const char *mode);
+
+	/**
+	 * Destructor.
+	 */
+	~FramebufferTexture ();
+
+	/**
+	 * Creates the texture and the framebuffer object.
+	 *
+	 * @param width		the texture width.
+	 * @param height	the texture height.
+	 *
+	 * @return	true on success, false if framebuffer objects are not
+	 *		supported or the format cannot be rendered to.
+	 */
+	bool Initialize (int width,
+			 int height);
+
+	/**
+	 * Directs rendering into the texture.
+	 *
+	 * @return	true on success.
+	 */
+	bool BeginCapture ();
+
+	/**
+	 * Directs rendering back to where it went before BeginCapture.
+	 *
+	 * @return	true on success.
+	 */
+	bool EndCapture ();
+
+	/**
+	 * Binds the texture to the active texture unit.
+	 */
+	void Bind () const;
+
+	/**
+	 * Enables the texture target.
+	 */
+	void EnableTextureTarget () const;
+
+	/**
+	 * Disables the texture target.
+	 */
+	void DisableTextureTarget () const;
+
+	/**
+	 * Returns the texture target.
+	 */
+	unsigned int GetTextureTarget () const;
+
+	/**
+	 * Returns the texture width.
+	 */
+	int GetWidth () const;
+
+	/**
+	 * Returns the texture height.
+	 */
+	int GetHeight () const;
+
+private:
+	/// Texture target and internal format.
+	GLenum target;
+	GLint format;
+
+	/// Texture dimensions.
+	int width;
+	int height;
+
+	/// Texture and framebuffer object ids.
+	GLuint tex;
+	GLuint fbo;
+
+	/// Framebuffer bound before BeginCapture.
+	GLint previous;
+
+	/// State kept from one capture to the next.
+	GLint viewport[4];
+	GLfloat projection[16];
+	GLfloat modelview[16];
+	GLfloat texture[16];
+	GLfloat clear[4];
+	GLint matrix_mode;
+};
+
+inline void
+FramebufferTexture::Bind () const
+{
+	glBindTexture (target, tex);
+}
+
+inline void
+FramebufferTexture::EnableTextureTarget () const
+{
+	glEnable (target);
+}
+
+inline void
+FramebufferTexture::DisableTextureTarget () const
+{
+	glDisable (target);
+}
+
+inline unsigned int
+FramebufferTexture::GetTextureTarget () const
+{
+	return target;
+}
+
+inline int
+FramebufferTexture::GetWidth () const
+{
+	return width;
+}
+
+inline int
+FramebufferTexture::GetHeight () const
+{
+	return height;
+}
+
+#endif // FRAMEBUFFERTEXTURE_HPP
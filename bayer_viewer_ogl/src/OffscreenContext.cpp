@@ -0,0 +1,141 @@
+#include <cstring>
+#include <iostream>
+#include "OffscreenContext.hpp"
+// Keep the X11 headers, and their macros, out of eglplatform.h.
+#define EGL_NO_X11
+#define MESA_EGL_NO_X11_HEADERS
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#ifndef EGL_PLATFORM_SURFACELESS_MESA
+# define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+#endif
+
+/// true if the space-separated list has the extension.
+static bool
+has_extension (const char *list,
+	       const char *name)
+{
+	size_t len = strlen (name);
+	const char *p = list;
+
+	while (p != NULL && (p = strstr (p, name)) != NULL) {
+		if ((p == list || p[-1] == ' ') && (p[len] == ' ' || p[len] == '\0')) {
+			return true;
+		}
+		p += len;
+	}
+	return false;
+}
+
+OffscreenContext::OffscreenContext () :
+	display (EGL_NO_DISPLAY),
+	context (EGL_NO_CONTEXT),
+	fbo (0),
+	color (0),
+	width (0),
+	height (0)
+{
+}
+
+OffscreenContext::~OffscreenContext ()
+{
+	if (context != EGL_NO_CONTEXT) {
+		if (fbo != 0) {
+			glDeleteFramebuffersEXT (1, &fbo);
+		}
+		if (color != 0) {
+			glDeleteRenderbuffersEXT (1, &color);
+		}
+		eglMakeCurrent (display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		eglDestroyContext (display, context);
+	}
+	if (display != EGL_NO_DISPLAY) {
+		eglTerminate (display);
+	}
+}
+
+bool
+OffscreenContext::Initialize (int w,
+			      int h)
+{
+	static const EGLint CONFIG[] =
+	{
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+		EGL_NONE
+	};
+	EGLDisplay dpy = EGL_NO_DISPLAY;
+	EGLConfig config;
+	EGLint n;
+
+	// Prefer the surfaceless platform, then whatever the default
+	// display is.
+	const char *client = eglQueryString (EGL_NO_DISPLAY, EGL_EXTENSIONS);
+	PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display =
+		(PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress ("eglGetPlatformDisplayEXT");
+	if (get_platform_display != NULL && has_extension (client, "EGL_MESA_platform_surfaceless")) {
+		dpy = get_platform_display (EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+	}
+	if (dpy == EGL_NO_DISPLAY) {
+		dpy = eglGetDisplay (EGL_DEFAULT_DISPLAY);
+	}
+	if (dpy == EGL_NO_DISPLAY || !eglInitialize (dpy, NULL, NULL)) {
+		std::cerr << "ERROR: no EGL display" << std::endl;
+		return false;
+	}
+	display = dpy;
+	if (!has_extension (eglQueryString (dpy, EGL_EXTENSIONS), "EGL_KHR_surfaceless_context")) {
+		std::cerr << "ERROR: EGL_KHR_surfaceless_context not supported" << std::endl;
+		return false;
+	}
+	if (!eglBindAPI (EGL_OPENGL_API) ||
+	    !eglChooseConfig (dpy, CONFIG, &config, 1, &n) || n < 1) {
+		std::cerr << "ERROR: no EGL config for desktop OpenGL" << std::endl;
+		return false;
+	}
+	context = eglCreateContext (dpy, config, EGL_NO_CONTEXT, NULL);
+	if (context == EGL_NO_CONTEXT) {
+		std::cerr << "ERROR: unable to create EGL context (0x" << std::hex << eglGetError () << std::dec << ")" << std::endl;
+		return false;
+	}
+	if (!eglMakeCurrent (dpy, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+		std::cerr << "ERROR: unable to make EGL context current" << std::endl;
+		return false;
+	}
+
+	// Initialize GLEW.  GLEW 2 goes on to look for a GLX display after
+	// loading the GL entry points, which fails without X; that is
+	// harmless here.
+	GLenum err = glewInit ();
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+	if (err == GLEW_ERROR_NO_GLX_DISPLAY) {
+		err = GLEW_OK;
+	}
+#endif
+	if (GLEW_OK != err) {
+		std::cerr << "GLEW ERROR: " << glewGetErrorString (err) << std::endl;
+		return false;
+	}
+	if (!GLEW_EXT_framebuffer_object) {
+		std::cerr << "ERROR: GL_EXT_framebuffer_object not supported" << std::endl;
+		return false;
+	}
+
+	// Framebuffer in place of the window.
+	width = w;
+	height = h;
+	glGenRenderbuffersEXT (1, &color);
+	glBindRenderbufferEXT (GL_RENDERBUFFER_EXT, color);
+	glRenderbufferStorageEXT (GL_RENDERBUFFER_EXT, GL_RGBA8, w, h);
+	glGenFramebuffersEXT (1, &fbo);
+	glBindFramebufferEXT (GL_FRAMEBUFFER_EXT, fbo);
+	glFramebufferRenderbufferEXT (GL_FRAMEBUFFER_EXT, GL_COLOR_ATTACHMENT0_EXT, GL_RENDERBUFFER_EXT, color);
+	GLenum status = glCheckFramebufferStatusEXT (GL_FRAMEBUFFER_EXT);
+	if (status != GL_FRAMEBUFFER_COMPLETE_EXT) {
+		std::cerr << "ERROR: framebuffer object incomplete (0x" << std::hex << status << std::dec << ")" << std::endl;
+		return false;
+	}
+	glViewport (0, 0, w, h);
+	return true;
+}
@@ -0,0 +1,145 @@
+/**
+ * @file   QualityController.hpp
+ * @brief  Chooses a demosaicing quality level that meets a time budget.
+ */
+
+#ifndef QUALITYCONTROLLER_HPP
+#define QUALITYCONTROLLER_HPP
+
+/**
+ * Quality controller.  Fed the time each frame took, it steps down to a
+ * cheaper level (a higher number) when the smoothed time exceeds the
+ * budget, and back up once the better level is predicted to fit with
+ * #STEP_UP headroom.  The prediction uses the cost ratio between
+ * neighbouring levels measured at the last switch, so a level is not
+ * retried while load keeps it out of reach.
+ *
+ * USAGE:
+ *	QualityController quality (levels, 1.0 / 29.97);
+ *	while (loop) {
+ *		double start = QualityController::now ();
+ *		// render at quality.get_level ()
+ *		quality.update (QualityController::now () - start);
+ *	}
+ */
+class QualityController
+{
+public:
+	/**
+	 * Constructor.
+	 *
+	 * @param levels	the number of quality levels, 0 being the best.
+	 * @param budget	the time budget per frame in seconds.
+	 */
+	QualityController (int levels,
+			   double budget);
+
+	/**
+	 * Destructor.
+	 */
+	~QualityController ();
+
+	/**
+	 * Accounts for one frame.
+	 *
+	 * @param seconds	the time the frame took.
+	 *
+	 * @return	true if the level changed.
+	 */
+	bool update (double seconds);
+
+	/**
+	 * Returns the level to render the next frame at.
+	 */
+	int get_level () const;
+
+	/**
+	 * Forces a level; the controller adapts from there.
+	 */
+	void set_level (int level);
+
+	/**
+	 * Returns the time budget per frame in seconds.
+	 */
+	double get_budget () const;
+
+	/**
+	 * Sets the time budget per frame in seconds.
+	 */
+	void set_budget (double budget);
+
+	/**
+	 * Returns the smoothed frame time in seconds.
+	 */
+	double get_time () const;
+
+	/**
+	 * Returns a wall-clock time stamp in seconds.
+	 */
+	static double now ();
+
+public:
+	/// Weight of each new frame time in the smoothed time.
+	static const double SMOOTHING;
+
+	/// Fraction of the budget a better level must be predicted to fit in.
+	static const double STEP_UP;
+
+	/// Frames to wait after a change before judging the new level.
+	static const int SETTLE;
+
+private:
+	/// Number of levels.
+	int levels;
+
+	/// Current level.
+	int level;
+
+	/// Time budget per frame.
+	double budget;
+
+	/// Smoothed frame time at the current level, or < 0 if unknown.
+	double time;
+
+	/// Frames left before the current level is judged.
+	int settle;
+
+	/// Level and smoothed time before the last change.
+	int previous_level;
+	double previous_time;
+
+	/// ratio[l] is the cost of level l - 1 relative to level l.
+	double *ratio;
+
+private:
+	/**
+	 * Switches to a level and starts settling.
+	 */
+	void change (int level);
+};
+
+inline int
+QualityController::get_level () const
+{
+	return level;
+}
+
+inline double
+QualityController::get_budget () const
+{
+	return budget;
+}
+
+inline void
+QualityController::set_budget (double budget)
+{
+	this->budget = budget;
+}
+
+inline double
+QualityController::get_time () const
+{
+	return time;
+}
+
+#endif // QUALITYCONTROLLER_HPP
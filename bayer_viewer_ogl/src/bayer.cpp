@@ -37,6 +37,12 @@ static int tile_colors[8][4] = {
 #define GREEN 1
 #define BLUE 2
 
+int
+gp_bayer_colour (BayerTile tile, int x, int y)
+{
+	return (tile_colors[tile][(x&1?0:1) + (y&1?0:2)]);
+}
+
 int
 gp_bayer_expand (const unsigned char *input, int w, int h, unsigned char *output,
 		 BayerTile tile)
@@ -96,6 +102,26 @@ gp_bayer_expand (const unsigned char *input, int w, int h, unsigned char *output
 
 int
 gp_bayer_interpolate (unsigned char *image, int w, int h, BayerTile tile)
+{
+	return (gp_bayer_interpolate_rows (image, w, h, 0, h, tile));
+}
+
+int
+gp_bayer_interpolate_rows (unsigned char *image, int w, int h, int y0, int y1,
+			   BayerTile tile)
+{
+	return (gp_bayer_interpolate_rect (image, w, h, 0, y0, w, y1, tile));
+}
+
+/*
+ * Interpolates the rectangle [x0, x1) x [y0, y1) only.  Reads the
+ * sample colours of a one-pixel border around it and writes only the
+ * missing colours inside it, so disjoint rectangles may be interpolated
+ * concurrently.
+ */
+int
+gp_bayer_interpolate_rect (unsigned char *image, int w, int h, int x0, int y0,
+			   int x1, int y1, BayerTile tile)
 {
 	int x, y, bayer;
 	int p0, p1, p2, p3;
@@ -121,8 +147,8 @@ gp_bayer_interpolate (unsigned char *image, int w, int h, BayerTile tile)
 		break;
 	}
 
-	for (y = 0; y < h; y++)
-		for (x = 0; x < w; x++) {
+	for (y = y0; y < y1 && y < h; y++)
+		for (x = x0; x < x1 && x < w; x++) {
 			bayer = (x&1?0:1) + (y&1?0:2);
 			if ( bayer == p0 ) {
 				
@@ -37,6 +37,11 @@ int gp_bayer_expand (const unsigned char *input, int w, int h, unsigned char *ou
 int gp_bayer_decode (const unsigned char *input, int w, int h, unsigned char *output,
 		     BayerTile tile);
 int gp_bayer_interpolate (unsigned char *image, int w, int h, BayerTile tile);
+int gp_bayer_interpolate_rows (unsigned char *image, int w, int h, int y0, int y1,
+			       BayerTile tile);
+int gp_bayer_interpolate_rect (unsigned char *image, int w, int h, int x0, int y0,
+			       int x1, int y1, BayerTile tile);
+int gp_bayer_colour (BayerTile tile, int x, int y);	/* 0 = red, 1 = green, 2 = blue */
 
 #endif /* __BAYER_H__ */
 
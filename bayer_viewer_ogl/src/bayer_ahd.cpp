@@ -0,0 +1,290 @@
+/**
+ * @file   bayer_ahd.cpp
+ * @brief  Adaptive homogeneity-directed (AHD) demosaicing.
+ */
+
+#include <cmath>
+#include "bayer_ahd.h"
+#include "bayer_sample.h"
+#include "bayer_strip.h"
+
+/* Side of the scratch planes: a tile and its halo. */
+#define SIDE (BAYER_AHD_TILE + 2 * BAYER_AHD_HALO)
+
+/* Entries of the CIELab companding table over [0, 1]. */
+#define LAB_TABLE 4096
+
+/* CIELab components are stored multiplied by LAB_SCALE. */
+#define LAB_SCALE 16
+
+#define MIN(a, b) (((a) < (b)) ? (a) : (b))
+#define MAX(a, b) (((a) > (b)) ? (a) : (b))
+
+static float lab_table[LAB_TABLE];
+static bool lab_table_ready = false;
+
+/* sRGB (D65) to XYZ, normalised by the white point and scaled to table indices */
+static float xyz_rgb[3][3];
+
+static void
+init_lab_table ()
+{
+	static const double XYZ_RGB[3][3] = {
+		{ 0.412453, 0.357580, 0.180423 },
+		{ 0.212671, 0.715160, 0.072169 },
+		{ 0.019334, 0.119193, 0.950227 }
+	};
+	static const double WHITE[3] = { 0.950456, 1.0, 1.088754 };
+	int i, c;
+	double t;
+
+	if (lab_table_ready)
+		return;
+	for (i = 0; i < LAB_TABLE; i++) {
+		t = static_cast<double>(i) / (LAB_TABLE - 1);
+		lab_table[i] = (t > 0.008856) ? pow (t, 1.0 / 3.0) : 7.787 * t + 16.0 / 116.0;
+	}
+	for (i = 0; i < 3; i++)
+		for (c = 0; c < 3; c++)
+			xyz_rgb[i][c] = XYZ_RGB[i][c] / WHITE[i] * (LAB_TABLE - 1) / 255.0;
+	lab_table_ready = true;
+}
+
+static inline int
+table_index (float v)
+{
+	int i = static_cast<int>(v);
+	return ((i < 0) ? 0 : (i >= LAB_TABLE) ? LAB_TABLE - 1 : i);
+}
+
+static inline void
+rgb_to_lab (const unsigned char *rgb, short *lab)
+{
+	float f[3];
+	int i;
+
+	for (i = 0; i < 3; i++)
+		f[i] = lab_table[table_index (xyz_rgb[i][0] * rgb[0] + xyz_rgb[i][1] * rgb[1]
+					      + xyz_rgb[i][2] * rgb[2])];
+	lab[0] = static_cast<short>(LAB_SCALE * (116.0f * f[1] - 16.0f));
+	lab[1] = static_cast<short>(LAB_SCALE * 500.0f * (f[0] - f[1]));
+	lab[2] = static_cast<short>(LAB_SCALE * 200.0f * (f[1] - f[2]));
+}
+
+BayerAHDScratch *
+gp_bayer_ahd_scratch_new (void)
+{
+	BayerAHDScratch *scratch = new BayerAHDScratch;
+	int d;
+
+	init_lab_table ();
+	scratch->cfa = new unsigned char[SIDE * SIDE];
+	for (d = 0; d < 2; d++) {
+		scratch->green[d] = new unsigned char[SIDE * SIDE];
+		scratch->rgb[d] = new unsigned char[SIDE * SIDE * 3];
+		scratch->lab[d] = new short[SIDE * SIDE * 3];
+		scratch->homogeneity[d] = new unsigned char[SIDE * SIDE];
+	}
+	return (scratch);
+}
+
+void
+gp_bayer_ahd_scratch_free (BayerAHDScratch *scratch)
+{
+	int d;
+
+	if (!scratch)
+		return;
+	delete [] scratch->cfa;
+	for (d = 0; d < 2; d++) {
+		delete [] scratch->green[d];
+		delete [] scratch->rgb[d];
+		delete [] scratch->lab[d];
+		delete [] scratch->homogeneity[d];
+	}
+	delete scratch;
+}
+
+/*
+ * Demosaics the rectangle [x0, x1) x [y0, y1), at most #BAYER_AHD_TILE
+ * pixels each way, of an image expanded by gp_bayer_expand.  Reads the
+ * native samples of a #BAYER_AHD_HALO border around it, mirrored at the
+ * image edges, and writes only the missing colours inside it, so
+ * disjoint rectangles may be processed concurrently and the result
+ * does not depend on how the image is split.
+ */
+int
+gp_bayer_ahd_rect (unsigned char *image, int w, int h, int x0, int y0, int x1, int y1,
+		   BayerTile tile, BayerAHDScratch *scratch)
+{
+	static const int H = BAYER_AHD_HALO;
+	static const int ADJACENT[4] = { -1, 1, -SIDE, SIDE };	/* row, then column */
+	int x, y, i, d, n, c, o, g, colour[4], hc, vc;
+	int rw, rh, ox, oy;
+	int ld[2][4], abd[2][4], leps, abeps, hm[2], dl, da, db;
+	unsigned char *cfa = scratch->cfa;
+	const unsigned char *rgb;
+	unsigned char *q;
+	short *lab;
+
+	if (tile > BAYER_TILE_GBRG || w <= H || h <= H)
+		return (-1);
+	if (x1 > w)
+		x1 = w;
+	if (y1 > h)
+		y1 = h;
+	rw = x1 - x0;
+	rh = y1 - y0;
+	if (rw <= 0 || rh <= 0)
+		return (0);
+	if (rw > BAYER_AHD_TILE || rh > BAYER_AHD_TILE)
+		return (-1);
+
+	/* scratch (x, y) is image (x + ox, y + oy); colours by parity */
+	ox = x0 - H;
+	oy = y0 - H;
+	for (i = 0; i < 4; i++)
+		colour[i] = gp_bayer_colour (tile, ox + (i & 1), oy + (i >> 1));
+#define COLOUR(x, y) colour[((x) & 1) + 2 * ((y) & 1)]
+
+	/* native samples, mirrored past the image edges */
+	for (y = 0; y < rh + 2 * H; y++) {
+		const unsigned char *row = image + bayer_mirror (y + oy, h) * w * 3;
+		for (x = 0; x < rw + 2 * H; x++)
+			cfa[y * SIDE + x] = row[bayer_mirror (x + ox, w) * 3 + COLOUR (x, y)];
+	}
+
+	/* green along rows (d = 0) and columns (d = 1), bounded by its neighbours */
+	for (y = H - 3; y < H + rh + 3; y++)
+		for (x = H - 3, i = y * SIDE + x; x < H + rw + 3; x++, i++) {
+			if (COLOUR (x, y) == 1) {
+				scratch->green[0][i] = scratch->green[1][i] = cfa[i];
+				continue;
+			}
+			for (d = 0; d < 2; d++) {
+				n = d ? SIDE : 1;
+				g = ((cfa[i - n] + cfa[i] + cfa[i + n]) * 2 - cfa[i - 2 * n] - cfa[i + 2 * n]) >> 2;
+				if (cfa[i - n] < cfa[i + n])
+					g = (g < cfa[i - n]) ? cfa[i - n] : (g > cfa[i + n]) ? cfa[i + n] : g;
+				else
+					g = (g < cfa[i + n]) ? cfa[i + n] : (g > cfa[i - n]) ? cfa[i - n] : g;
+				scratch->green[d][i] = g;
+			}
+		}
+
+	/* red and blue from colour differences against each green, then CIELab */
+	for (d = 0; d < 2; d++) {
+		const unsigned char *gr = scratch->green[d];
+		for (y = H - 2; y < H + rh + 2; y++)
+			for (x = H - 2, i = y * SIDE + x; x < H + rw + 2; x++, i++) {
+				q = scratch->rgb[d] + i * 3;
+				c = COLOUR (x, y);
+				q[1] = gr[i];
+				if (c == 1) {
+					vc = COLOUR (x, y + 1);
+					hc = 2 - vc;
+					q[hc] = bayer_clamp (gr[i] + ((cfa[i - 1] + cfa[i + 1]
+								       - gr[i - 1] - gr[i + 1]) >> 1));
+					q[vc] = bayer_clamp (gr[i] + ((cfa[i - SIDE] + cfa[i + SIDE]
+								       - gr[i - SIDE] - gr[i + SIDE]) >> 1));
+				} else {
+					o = 2 - c;
+					q[c] = cfa[i];
+					q[o] = bayer_clamp (gr[i] + ((cfa[i - SIDE - 1] + cfa[i - SIDE + 1]
+								      + cfa[i + SIDE - 1] + cfa[i + SIDE + 1]
+								      - gr[i - SIDE - 1] - gr[i - SIDE + 1]
+								      - gr[i + SIDE - 1] - gr[i + SIDE + 1] + 1) >> 2));
+				}
+				rgb_to_lab (q, scratch->lab[d] + i * 3);
+			}
+	}
+
+	/*
+	 * Count the neighbours of each candidate within the luminance and
+	 * chrominance distances set by the smaller of the horizontal
+	 * candidate's row and the vertical candidate's column neighbours.
+	 */
+	for (y = H - 1; y < H + rh + 1; y++)
+		for (x = H - 1, i = y * SIDE + x; x < H + rw + 1; x++, i++) {
+			for (d = 0; d < 2; d++) {
+				lab = scratch->lab[d] + i * 3;
+				for (n = 0; n < 4; n++) {
+					const short *adj = lab + ADJACENT[n] * 3;
+					dl = lab[0] - adj[0];
+					da = lab[1] - adj[1];
+					db = lab[2] - adj[2];
+					ld[d][n] = (dl < 0) ? -dl : dl;
+					abd[d][n] = da * da + db * db;
+				}
+			}
+			leps = MIN (MAX (ld[0][0], ld[0][1]), MAX (ld[1][2], ld[1][3]));
+			abeps = MIN (MAX (abd[0][0], abd[0][1]), MAX (abd[1][2], abd[1][3]));
+			for (d = 0; d < 2; d++) {
+				scratch->homogeneity[d][i] = 0;
+				for (n = 0; n < 4; n++)
+					if (ld[d][n] <= leps && abd[d][n] <= abeps)
+						scratch->homogeneity[d][i]++;
+			}
+		}
+
+	/* pick the more homogeneous candidate over 3x3, or their mean on a tie */
+	for (y = H; y < H + rh; y++)
+		for (x = H, i = y * SIDE + x; x < H + rw; x++, i++) {
+			for (d = 0; d < 2; d++) {
+				const unsigned char *hp = scratch->homogeneity[d] + i;
+				hm[d] = hp[-SIDE - 1] + hp[-SIDE] + hp[-SIDE + 1]
+					+ hp[-1] + hp[0] + hp[1]
+					+ hp[SIDE - 1] + hp[SIDE] + hp[SIDE + 1];
+			}
+			c = COLOUR (x, y);
+			q = image + ((y + oy) * w + x + ox) * 3;
+			if (hm[0] != hm[1]) {
+				rgb = scratch->rgb[hm[1] > hm[0]] + i * 3;
+				for (n = 0; n < 3; n++)
+					if (n != c)
+						q[n] = rgb[n];
+			} else {
+				for (n = 0; n < 3; n++)
+					if (n != c)
+						q[n] = (scratch->rgb[0][i * 3 + n] + scratch->rgb[1][i * 3 + n] + 1) >> 1;
+			}
+		}
+#undef COLOUR
+
+	return (0);
+}
+
+/*
+ * Demosaics a whole image expanded by gp_bayer_expand, one tile per
+ * OpenMP thread at a time, with one scratch area per thread.
+ */
+int
+gp_bayer_ahd (unsigned char *image, int w, int h, BayerTile tile)
+{
+	int t, i;
+	int tiles_x = (w + BAYER_AHD_TILE - 1) / BAYER_AHD_TILE;
+	int tiles_y = (h + BAYER_AHD_TILE - 1) / BAYER_AHD_TILE;
+	int threads = bayer_strip_threads ();
+	BayerAHDScratch **scratch;
+
+	if (tile > BAYER_TILE_GBRG || w <= BAYER_AHD_HALO || h <= BAYER_AHD_HALO)
+		return (-1);
+
+	scratch = new BayerAHDScratch *[threads];
+	for (i = 0; i < threads; i++)
+		scratch[i] = gp_bayer_ahd_scratch_new ();
+
+#pragma omp parallel for schedule(dynamic)
+	for (t = 0; t < tiles_x * tiles_y; t++) {
+		int x0 = (t % tiles_x) * BAYER_AHD_TILE;
+		int y0 = (t / tiles_x) * BAYER_AHD_TILE;
+		gp_bayer_ahd_rect (image, w, h, x0, y0, x0 + BAYER_AHD_TILE, y0 + BAYER_AHD_TILE,
+				   tile, scratch[bayer_strip_thread ()]);
+	}
+
+	for (i = 0; i < threads; i++)
+		gp_bayer_ahd_scratch_free (scratch[i]);
+	delete [] scratch;
+
+	return (0);
+}
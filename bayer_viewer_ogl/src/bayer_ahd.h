@@ -0,0 +1,45 @@
+/**
+ * @file   bayer_ahd.h
+ * @brief  Adaptive homogeneity-directed (AHD) demosaicing.
+ *
+ * Hirakawa and Parks' method: the image is interpolated twice, once
+ * along rows and once along columns, both candidates are converted to
+ * CIELab, and each pixel takes the candidate whose 3x3 neighbourhood is
+ * more homogeneous in luminance and chrominance.  Much slower than the
+ * interpolation used for live display, for stills where artefacts at
+ * fine detail matter.
+ *
+ * The image is processed in independent tiles of #BAYER_AHD_TILE square
+ * pixels, each in a fixed-size scratch area per thread, so the memory
+ * used beyond the image does not grow with its size.  Images must be
+ * larger than #BAYER_AHD_HALO pixels each way.
+ */
+
+#ifndef __BAYER_AHD_H__
+#define __BAYER_AHD_H__
+
+#include "bayer.h"
+
+/* Width and height of the tiles processed independently. */
+#define BAYER_AHD_TILE 64
+
+/* Rows and columns of native samples read around a tile. */
+#define BAYER_AHD_HALO 5
+
+/* Working planes for one tile and its halo. */
+typedef struct {
+	unsigned char *cfa;		/* native samples */
+	unsigned char *green[2];	/* green interpolated along rows, columns */
+	unsigned char *rgb[2];		/* full colour from each green */
+	short *lab[2];			/* CIELab of each candidate */
+	unsigned char *homogeneity[2];	/* homogeneous neighbours of each */
+} BayerAHDScratch;
+
+BayerAHDScratch *gp_bayer_ahd_scratch_new (void);
+void gp_bayer_ahd_scratch_free (BayerAHDScratch *scratch);
+
+int gp_bayer_ahd_rect (unsigned char *image, int w, int h, int x0, int y0, int x1, int y1,
+		       BayerTile tile, BayerAHDScratch *scratch);
+int gp_bayer_ahd (unsigned char *image, int w, int h, BayerTile tile);
+
+#endif /* __BAYER_AHD_H__ */
@@ -0,0 +1,183 @@
+/**
+ * @file   bayer_defects.cpp
+ * @brief  Static defect (hot/dead pixel) maps for Bayer pattern images.
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include "bayer_defects.h"
+
+#define GREEN 1
+
+static int
+compare_coords (const void *a, const void *b)
+{
+	const int *p = (const int *) a;
+	const int *q = (const int *) b;
+
+	if (p[1] != q[1])
+		return (p[1] - q[1]);
+	return (p[0] - q[0]);
+}
+
+/*
+ * Builds a defect map from n (x, y) pairs stored as
+ * coords[2*i], coords[2*i+1].  Pairs outside the image are dropped.
+ */
+BayerDefects *
+gp_bayer_defects_new (const int *coords, int n, int w, int h)
+{
+	BayerDefects *defects;
+	int *sorted;
+	int i, y;
+
+	sorted = new int[2 * n + 2];
+	for (i = 0; i < 2 * n; i++)
+		sorted[i] = coords[i];
+	qsort (sorted, n, 2 * sizeof (int), compare_coords);
+
+	defects = new BayerDefects;
+	defects->w = w;
+	defects->h = h;
+	defects->count = 0;
+	defects->x = new int[n + 1];
+	defects->row_start = new int[h + 1];
+	for (i = 0, y = 0; i < n; i++) {
+		if (sorted[2*i] < 0 || sorted[2*i] >= w ||
+		    sorted[2*i+1] < 0 || sorted[2*i+1] >= h)
+			continue;
+		while (y <= sorted[2*i+1])
+			defects->row_start[y++] = defects->count;
+		defects->x[defects->count++] = sorted[2*i];
+	}
+	while (y <= h)
+		defects->row_start[y++] = defects->count;
+	delete [] sorted;
+
+	return (defects);
+}
+
+/* Builds a defect map from a w x h mask; nonzero entries are defects. */
+BayerDefects *
+gp_bayer_defects_new_from_mask (const unsigned char *mask, int w, int h)
+{
+	BayerDefects *defects;
+	int *coords;
+	int i, x, y, n = 0;
+
+	for (i = 0; i < w * h; i++)
+		if (mask[i])
+			n++;
+	coords = new int[2 * n + 2];
+	n = 0;
+	for (y = 0; y < h; y++)
+		for (x = 0; x < w; x++)
+			if (mask[y * w + x]) {
+				coords[2*n] = x;
+				coords[2*n+1] = y;
+				n++;
+			}
+	defects = gp_bayer_defects_new (coords, n, w, h);
+	delete [] coords;
+
+	return (defects);
+}
+
+void
+gp_bayer_defects_free (BayerDefects *defects)
+{
+	if (defects == NULL)
+		return;
+	delete [] defects->x;
+	delete [] defects->row_start;
+	delete defects;
+}
+
+/* median of n (1..4) values; the mean of the middle two when n is even */
+static int
+median (int *v, int n)
+{
+	int i, j, t;
+
+	for (i = 1; i < n; i++)
+		for (j = i; j > 0 && v[j-1] > v[j]; j--) {
+			t = v[j]; v[j] = v[j-1]; v[j-1] = t;
+		}
+	if (n & 1)
+		return (v[n >> 1]);
+	return ((v[(n >> 1) - 1] + v[n >> 1] + 1) >> 1);
+}
+
+/*
+ * Corrected value of the sample at (x, y) in input: the median of its
+ * same-colour neighbours, the four diagonals for green and the four
+ * samples two pixels away for red and blue.
+ */
+static int
+corrected_sample (const unsigned char *input, int w, int h, int x, int y, BayerTile tile)
+{
+	static const int diagonal[4][2] = {{-1, -1}, {1, -1}, {-1, 1}, {1, 1}};
+	static const int cross[4][2]    = {{-2, 0}, {2, 0}, {0, -2}, {0, 2}};
+	const int (*offset)[2];
+	int k, n, nx, ny;
+	int v[4];
+
+	offset = (gp_bayer_colour (tile, x, y) == GREEN) ? diagonal : cross;
+	for (k = 0, n = 0; k < 4; k++) {
+		nx = x + offset[k][0];
+		ny = y + offset[k][1];
+		if (nx >= 0 && nx < w && ny >= 0 && ny < h)
+			v[n++] = input[ny * w + nx];
+	}
+	return ((n > 0) ? median (v, n) : input[y * w + x]);
+}
+
+/*
+ * Overwrites the defective samples of rows [y0, y1) in the expanded
+ * image output with their corrected values.
+ */
+int
+gp_bayer_defects_correct_rows (const BayerDefects *defects, const unsigned char *input,
+			       int w, int h, int y0, int y1, unsigned char *output,
+			       BayerTile tile)
+{
+	int i, x, y;
+
+	/* the map must describe this frame, or row_start and x mislead */
+	if (tile > BAYER_TILE_GBRG || defects->w != w || defects->h != h)
+		return (-1);
+	if (y1 > h)
+		y1 = h;
+
+	for (y = y0; y < y1; y++) {
+		for (i = defects->row_start[y]; i < defects->row_start[y+1]; i++) {
+			x = defects->x[i];
+			output[(y * w + x) * 3 + gp_bayer_colour (tile, x, y)] =
+				corrected_sample (input, w, h, x, y, tile);
+		}
+	}
+
+	return (0);
+}
+
+/*
+ * Returns CFA row y of input with its defects corrected: the input row
+ * itself when the row has none, else row, filled with a corrected copy
+ * of w samples.  The map must match w x h.
+ */
+const unsigned char *
+gp_bayer_defects_cfa_row (const BayerDefects *defects, const unsigned char *input,
+			  int w, int h, int y, BayerTile tile, unsigned char *row)
+{
+	int i, x;
+
+	if (defects == NULL || defects->row_start[y] == defects->row_start[y+1])
+		return (input + y * w);
+
+	memcpy (row, input + y * w, w);
+	for (i = defects->row_start[y]; i < defects->row_start[y+1]; i++) {
+		x = defects->x[i];
+		row[x] = corrected_sample (input, w, h, x, y, tile);
+	}
+	return (row);
+}
@@ -0,0 +1,35 @@
+/**
+ * @file   bayer_defects.h
+ * @brief  Static defect (hot/dead pixel) maps for Bayer pattern images.
+ *
+ * Defects are kept as a list of columns sorted by row, with an index of
+ * where each row starts, so rows without defects cost one comparison.
+ * Defective samples are replaced by the median of their same-colour
+ * neighbours, either in the expanded image or, for stages that read the
+ * CFA such as the denoise pre-filter, in a copy of a CFA row.
+ */
+
+#ifndef __BAYER_DEFECTS_H__
+#define __BAYER_DEFECTS_H__
+
+#include "bayer.h"
+
+typedef struct {
+	int w, h;
+	int count;
+	int *x;			/* defect columns, sorted by row, then column */
+	int *row_start;		/* defects of row y: x[row_start[y]] .. x[row_start[y+1]-1] */
+} BayerDefects;
+
+BayerDefects *gp_bayer_defects_new (const int *coords, int n, int w, int h);
+BayerDefects *gp_bayer_defects_new_from_mask (const unsigned char *mask, int w, int h);
+void gp_bayer_defects_free (BayerDefects *defects);
+
+int gp_bayer_defects_correct_rows (const BayerDefects *defects, const unsigned char *input,
+				   int w, int h, int y0, int y1, unsigned char *output,
+				   BayerTile tile);
+const unsigned char *gp_bayer_defects_cfa_row (const BayerDefects *defects,
+					       const unsigned char *input, int w, int h, int y,
+					       BayerTile tile, unsigned char *row);
+
+#endif /* __BAYER_DEFECTS_H__ */
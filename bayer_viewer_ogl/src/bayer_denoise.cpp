@@ -0,0 +1,128 @@
+/**
+ * @file   bayer_denoise.cpp
+ * @brief  Same-channel noise reduction on Bayer pattern images.
+ */
+
+#include "bayer_denoise.h"
+#ifdef __SSE2__
+# include <emmintrin.h>
+#endif
+
+/* filtered value of sample x of row r, given rows above (a) and below (b) */
+static inline int
+denoise_sample (const unsigned char *a, const unsigned char *r, const unsigned char *b,
+		int x, int xl, int xr, int threshold)
+{
+	const unsigned char *rows[3] = {a, r, b};
+	int cols[3] = {xl, x, xr};
+	int c = r[x], i, j, n, d, wt;
+	int sum = 0, sum_w = 0;
+
+	for (i = 0; i < 3; i++)
+		for (j = 0; j < 3; j++) {
+			n = rows[i][cols[j]];
+			d = (n > c) ? n - c : c - n;
+			wt = (d < threshold) ? threshold - d : 0;
+			sum += wt * n;
+			sum_w += wt;
+		}
+
+	return ((sum + (sum_w >> 1)) / sum_w);
+}
+
+/*
+ * Filters row r into out, with a and b the same-colour rows above and
+ * below.  Interior columns take eight samples per step with SSE2; the
+ * two columns at each edge mirror their missing neighbours.
+ */
+static void
+denoise_row (const unsigned char *a, const unsigned char *r, const unsigned char *b,
+	     int w, int threshold, unsigned char *out)
+{
+	int x = 0;
+
+	for (; x < 2 && x < w; x++)
+		out[x] = denoise_sample (a, r, b, x, (x + 2 < w) ? x + 2 : x,
+					 (x + 2 < w) ? x + 2 : x, threshold);
+
+#ifdef __SSE2__
+	const __m128i zero = _mm_setzero_si128 ();
+	const __m128i t = _mm_set1_epi16 (threshold);
+	const unsigned char *rows[3] = {a, r, b};
+	int i, j, k;
+	int s[8], sw[8];
+
+	for (; x + 8 <= w - 2; x += 8) {
+		__m128i c = _mm_unpacklo_epi8 (_mm_loadl_epi64 ((const __m128i *) (r + x)), zero);
+		__m128i sum_lo = zero, sum_hi = zero, sum_w = zero;
+		for (i = 0; i < 3; i++)
+			for (j = -2; j <= 2; j += 2) {
+				__m128i n = _mm_unpacklo_epi8 (_mm_loadl_epi64 ((const __m128i *) (rows[i] + x + j)), zero);
+				__m128i d = _mm_or_si128 (_mm_subs_epu16 (n, c), _mm_subs_epu16 (c, n));
+				__m128i wt = _mm_subs_epu16 (t, d);
+				__m128i p = _mm_mullo_epi16 (wt, n);
+				sum_lo = _mm_add_epi32 (sum_lo, _mm_unpacklo_epi16 (p, zero));
+				sum_hi = _mm_add_epi32 (sum_hi, _mm_unpackhi_epi16 (p, zero));
+				sum_w = _mm_add_epi16 (sum_w, wt);
+			}
+		_mm_storeu_si128 ((__m128i *) s, sum_lo);
+		_mm_storeu_si128 ((__m128i *) (s + 4), sum_hi);
+		_mm_storeu_si128 ((__m128i *) sw, _mm_unpacklo_epi16 (sum_w, zero));
+		_mm_storeu_si128 ((__m128i *) (sw + 4), _mm_unpackhi_epi16 (sum_w, zero));
+		for (k = 0; k < 8; k++)
+			out[x + k] = (s[k] + (sw[k] >> 1)) / sw[k];
+	}
+#endif
+
+	for (; x < w - 2; x++)
+		out[x] = denoise_sample (a, r, b, x, x - 2, x + 2, threshold);
+	for (; x < w; x++)
+		out[x] = denoise_sample (a, r, b, x, (x >= 2) ? x - 2 : x,
+					 (x >= 2) ? x - 2 : x, threshold);
+}
+
+/*
+ * Writes the filtered samples of rows [y0, y1) into the expanded image
+ * output.  Neighbour rows come straight from the CFA, so strips share
+ * their halo rows without copying, unless they hold defects of the map
+ * defects (which may be NULL): those rows are corrected into a copy
+ * first.  Rows past the top and bottom edges are mirrored.
+ */
+int
+gp_bayer_denoise_rows (const unsigned char *input, int w, int h, int y0, int y1,
+		       int threshold, const BayerDefects *defects,
+		       unsigned char *output, BayerTile tile)
+{
+	int x, y, ya, yb, colour[2];
+	unsigned char *row, *fixed;
+	const unsigned char *a, *r, *b;
+
+	if (tile > BAYER_TILE_GBRG)
+		return (-1);
+	if (defects && (defects->w != w || defects->h != h))
+		return (-1);
+	if (threshold < 1)
+		return (0);
+	if (threshold > BAYER_DENOISE_MAX_THRESHOLD)
+		threshold = BAYER_DENOISE_MAX_THRESHOLD;
+	if (y1 > h)
+		y1 = h;
+
+	row = new unsigned char[4 * w];
+	fixed = row + w;
+	for (y = y0; y < y1; y++) {
+		ya = (y >= 2) ? y - 2 : ((y + 2 < h) ? y + 2 : y);
+		yb = (y + 2 < h) ? y + 2 : ((y >= 2) ? y - 2 : y);
+		a = gp_bayer_defects_cfa_row (defects, input, w, h, ya, tile, fixed);
+		r = gp_bayer_defects_cfa_row (defects, input, w, h, y, tile, fixed + w);
+		b = gp_bayer_defects_cfa_row (defects, input, w, h, yb, tile, fixed + 2 * w);
+		denoise_row (a, r, b, w, threshold, row);
+		colour[0] = gp_bayer_colour (tile, 0, y);
+		colour[1] = gp_bayer_colour (tile, 1, y);
+		for (x = 0; x < w; x++)
+			output[(y * w + x) * 3 + colour[x & 1]] = row[x];
+	}
+	delete [] row;
+
+	return (0);
+}
@@ -0,0 +1,30 @@
+/**
+ * @file   bayer_denoise.h
+ * @brief  Same-channel noise reduction on Bayer pattern images.
+ *
+ * Each sample is replaced by a range-weighted mean of the 3x3 block of
+ * same-colour samples around it (offsets of -2, 0 and +2 pixels).  A
+ * neighbour differing by d gets weight max (0, threshold - d), so edges
+ * are preserved while flat-area noise is averaged out.  Filtering the
+ * CFA touches a third of the data a post-demosaic RGB filter would and
+ * keeps noise from being smeared across channels by interpolation.
+ *
+ * Given a defect map, defective samples are corrected before filtering,
+ * so they neither stay noisier than their neighbours nor leak into
+ * their means.
+ */
+
+#ifndef __BAYER_DENOISE_H__
+#define __BAYER_DENOISE_H__
+
+#include "bayer.h"
+#include "bayer_defects.h"
+
+/* Largest supported range threshold. */
+#define BAYER_DENOISE_MAX_THRESHOLD 64
+
+int gp_bayer_denoise_rows (const unsigned char *input, int w, int h, int y0, int y1,
+			   int threshold, const BayerDefects *defects,
+			   unsigned char *output, BayerTile tile);
+
+#endif /* __BAYER_DENOISE_H__ */
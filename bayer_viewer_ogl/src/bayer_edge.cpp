@@ -0,0 +1,202 @@
+/**
+ * @file   bayer_edge.cpp
+ * @brief  Edge-directed (Hamilton-Adams) interpolation of Bayer pattern images.
+ */
+
+#include "bayer_edge.h"
+#include "bayer_sample.h"
+#ifdef __SSE2__
+# include <emmintrin.h>
+#endif
+
+/* Samples of padding on each side of an extracted CFA row. */
+#define PAD 2
+
+/* copies the native samples of row y into out, mirrored PAD samples past each end */
+static void
+extract_row (const unsigned char *image, int w, int y, BayerTile tile, unsigned char *out)
+{
+	const unsigned char *row = image + y * w * 3;
+	int colour[2], x;
+
+	colour[0] = gp_bayer_colour (tile, 0, y);
+	colour[1] = gp_bayer_colour (tile, 1, y);
+	for (x = 0; x < w; x++)
+		out[x] = row[x * 3 + colour[x & 1]];
+	for (x = 1; x <= PAD; x++) {
+		out[-x] = out[bayer_mirror (-x, w)];
+		out[w - 1 + x] = out[bayer_mirror (w - 1 + x, w)];
+	}
+}
+
+/* green estimate at a red or blue sample c from its row (l, r) and column (u, d) */
+static inline int
+edge_green (int c, int l1, int r1, int l2, int r2, int u1, int d1, int u2, int d2)
+{
+	int lap_h = 2 * c - l2 - r2;
+	int lap_v = 2 * c - u2 - d2;
+	int dh = ((l1 > r1) ? l1 - r1 : r1 - l1) + ((lap_h < 0) ? -lap_h : lap_h);
+	int dv = ((u1 > d1) ? u1 - d1 : d1 - u1) + ((lap_v < 0) ? -lap_v : lap_v);
+	int gh = 2 * (l1 + r1) + lap_h;
+	int gv = 2 * (u1 + d1) + lap_v;
+	int g = (dh < dv) ? gh : (dv < dh) ? gv : (gh + gv) >> 1;
+
+	return (bayer_clamp ((g + 2) >> 2));
+}
+
+/*
+ * Computes the green estimate of every sample of row c (padded), given
+ * the padded rows one (u1, d1) and two (u2, d2) above and below.  The
+ * interior takes eight samples per step with SSE2, choosing the
+ * direction with compare masks instead of branches.
+ */
+static void
+edge_green_row (const unsigned char *u2, const unsigned char *u1, const unsigned char *c,
+		const unsigned char *d1, const unsigned char *d2, int w, unsigned char *out)
+{
+	int x = 0;
+
+#ifdef __SSE2__
+	const __m128i zero = _mm_setzero_si128 ();
+	const __m128i two = _mm_set1_epi16 (2);
+
+#define LOAD(p) _mm_unpacklo_epi8 (_mm_loadl_epi64 ((const __m128i *) (p)), zero)
+#define ABS(v) _mm_max_epi16 ((v), _mm_sub_epi16 (zero, (v)))
+	for (; x + 8 <= w; x += 8) {
+		__m128i cc = LOAD (c + x);
+		__m128i c2 = _mm_add_epi16 (cc, cc);
+		__m128i l1 = LOAD (c + x - 1), r1 = LOAD (c + x + 1);
+		__m128i l2 = LOAD (c + x - 2), r2 = LOAD (c + x + 2);
+		__m128i n1 = LOAD (u1 + x), s1 = LOAD (d1 + x);
+		__m128i n2 = LOAD (u2 + x), s2 = LOAD (d2 + x);
+		__m128i lap_h = _mm_sub_epi16 (c2, _mm_add_epi16 (l2, r2));
+		__m128i lap_v = _mm_sub_epi16 (c2, _mm_add_epi16 (n2, s2));
+		__m128i dh = _mm_add_epi16 (ABS (_mm_sub_epi16 (l1, r1)), ABS (lap_h));
+		__m128i dv = _mm_add_epi16 (ABS (_mm_sub_epi16 (n1, s1)), ABS (lap_v));
+		__m128i gh = _mm_add_epi16 (_mm_slli_epi16 (_mm_add_epi16 (l1, r1), 1), lap_h);
+		__m128i gv = _mm_add_epi16 (_mm_slli_epi16 (_mm_add_epi16 (n1, s1), 1), lap_v);
+		__m128i avg = _mm_srai_epi16 (_mm_add_epi16 (gh, gv), 1);
+		__m128i h = _mm_cmplt_epi16 (dh, dv);
+		__m128i v = _mm_cmplt_epi16 (dv, dh);
+		__m128i g = _mm_or_si128 (_mm_or_si128 (_mm_and_si128 (h, gh), _mm_and_si128 (v, gv)),
+					  _mm_andnot_si128 (_mm_or_si128 (h, v), avg));
+		g = _mm_srai_epi16 (_mm_add_epi16 (g, two), 2);
+		_mm_storel_epi64 ((__m128i *) (out + x), _mm_packus_epi16 (g, g));
+	}
+#undef ABS
+#undef LOAD
+#endif
+
+	for (; x < w; x++)
+		out[x] = edge_green (c[x], c[x - 1], c[x + 1], c[x - 2], c[x + 2],
+				     u1[x], d1[x], u2[x], d2[x]);
+}
+
+/*
+ * Fills in green at the red and blue samples of rows [y0, y1) of an
+ * image expanded by gp_bayer_expand.  Reads native samples up to two
+ * rows and columns away, mirrored at the edges, and writes only the
+ * missing green, so disjoint row ranges may be processed concurrently.
+ */
+int
+gp_bayer_edge_green_rows (unsigned char *image, int w, int h, int y0, int y1,
+			  BayerTile tile)
+{
+	int x, y, i, stride = w + 2 * PAD;
+	unsigned char *buffer, *green, *rows[5];
+
+	if (tile > BAYER_TILE_GBRG || w < 3 || h < 3)
+		return (-1);
+	if (y1 > h)
+		y1 = h;
+	if (y0 >= y1)
+		return (0);
+
+	/* the five padded CFA rows around y, kept as a ring */
+	buffer = new unsigned char[5 * stride + w];
+	green = buffer + 5 * stride;
+	for (i = -2; i <= 1; i++)
+		extract_row (image, w, bayer_mirror (y0 + i, h), tile,
+			     buffer + ((y0 + i + 5) % 5) * stride + PAD);
+
+	for (y = y0; y < y1; y++) {
+		extract_row (image, w, bayer_mirror (y + 2, h), tile,
+			     buffer + ((y + 2) % 5) * stride + PAD);
+		for (i = 0; i < 5; i++)
+			rows[i] = buffer + ((y + i + 3) % 5) * stride + PAD;
+		edge_green_row (rows[0], rows[1], rows[2], rows[3], rows[4], w, green);
+
+		x = (gp_bayer_colour (tile, 0, y) == 1) ? 1 : 0;
+		for (; x < w; x += 2)
+			image[(y * w + x) * 3 + 1] = green[x];
+	}
+	delete [] buffer;
+
+	return (0);
+}
+
+/* red or blue minus green at pixel (x, y), mirrored at the edges */
+static inline int
+difference (const unsigned char *image, int w, int h, int x, int y, int colour)
+{
+	const unsigned char *p = image + (bayer_mirror (y, h) * w + bayer_mirror (x, w)) * 3;
+
+	return (p[colour] - p[1]);
+}
+
+/*
+ * Fills in red and blue in rows [y0, y1) from the mean colour
+ * difference of the nearest samples of each: the row or column
+ * neighbours at green samples and the diagonal neighbours at red and
+ * blue ones.  Green must be complete in rows y0 - 1 to y1 first.
+ * Writes only missing red and blue, so disjoint row ranges may be
+ * processed concurrently.
+ */
+int
+gp_bayer_edge_colour_rows (unsigned char *image, int w, int h, int y0, int y1,
+			   BayerTile tile)
+{
+	int x, y, colour, hc, vc, o, g;
+	int r = w * 3;
+	unsigned char *q;
+
+	if (tile > BAYER_TILE_GBRG || w < 3 || h < 3)
+		return (-1);
+	if (y1 > h)
+		y1 = h;
+
+	for (y = y0; y < y1; y++) {
+		for (x = 0; x < w; x++) {
+			q = image + (y * w + x) * 3;
+			colour = gp_bayer_colour (tile, x, y);
+			g = q[1];
+			if (colour == 1) {
+				hc = gp_bayer_colour (tile, x + 1, y);
+				vc = gp_bayer_colour (tile, x, y + 1);
+				if (x >= 1 && x < w - 1 && y >= 1 && y < h - 1) {
+					q[hc] = bayer_clamp ((2 * g + q[hc - 3] - q[-2] + q[hc + 3] - q[4] + 1) >> 1);
+					q[vc] = bayer_clamp ((2 * g + q[vc - r] - q[1 - r] + q[vc + r] - q[1 + r] + 1) >> 1);
+				} else {
+					q[hc] = bayer_clamp ((2 * g + difference (image, w, h, x - 1, y, hc)
+							+ difference (image, w, h, x + 1, y, hc) + 1) >> 1);
+					q[vc] = bayer_clamp ((2 * g + difference (image, w, h, x, y - 1, vc)
+							+ difference (image, w, h, x, y + 1, vc) + 1) >> 1);
+				}
+			} else {
+				o = 2 - colour;
+				if (x >= 1 && x < w - 1 && y >= 1 && y < h - 1)
+					q[o] = bayer_clamp ((4 * g + q[o - r - 3] - q[1 - r - 3]
+						             + q[o - r + 3] - q[1 - r + 3]
+						             + q[o + r - 3] - q[1 + r - 3]
+						             + q[o + r + 3] - q[1 + r + 3] + 2) >> 2);
+				else
+					q[o] = bayer_clamp ((4 * g + difference (image, w, h, x - 1, y - 1, o)
+						             + difference (image, w, h, x + 1, y - 1, o)
+						             + difference (image, w, h, x - 1, y + 1, o)
+						             + difference (image, w, h, x + 1, y + 1, o) + 2) >> 2);
+			}
+		}
+	}
+
+	return (0);
+}
@@ -0,0 +1,27 @@
+/**
+ * @file   bayer_edge.h
+ * @brief  Edge-directed (Hamilton-Adams) interpolation of Bayer pattern images.
+ *
+ * Green is interpolated first, along whichever of the horizontal and
+ * vertical directions has the smaller gradient (green difference plus
+ * the Laplacian of the sampled colour), and corrected by that
+ * Laplacian.  Red and blue follow by interpolating their differences
+ * from the full green plane.  Edges are followed rather than averaged
+ * across, which keeps fine diagonal and near-axial detail sharper than
+ * fixed kernels do.
+ *
+ * The two passes run one after the other over the whole image: the
+ * colour pass reads the green of neighbouring rows.
+ */
+
+#ifndef __BAYER_EDGE_H__
+#define __BAYER_EDGE_H__
+
+#include "bayer.h"
+
+int gp_bayer_edge_green_rows (unsigned char *image, int w, int h, int y0, int y1,
+			      BayerTile tile);
+int gp_bayer_edge_colour_rows (unsigned char *image, int w, int h, int y0, int y1,
+			       BayerTile tile);
+
+#endif /* __BAYER_EDGE_H__ */
@@ -0,0 +1,110 @@
+/**
+ * @file   bayer_focus.cpp
+ * @brief  Focus metrics computed on the green samples of Bayer pattern images.
+ */
+
+#include "bayer_focus.h"
+#ifdef __SSE2__
+# include <emmintrin.h>
+#endif
+
+#define GREEN 1
+
+/*
+ * Sum of squared differences between the green samples of row a in
+ * [x0, x1) and their diagonal neighbours b[x-1] and b[x+1] on the next
+ * row.  Greens of row a sit at columns of parity gp; the caller
+ * guarantees 1 <= x0 and x1 <= w - 1.
+ */
+static double
+green_energy_row (const unsigned char *a, const unsigned char *b, int x0, int x1, int gp)
+{
+	double energy = 0.0;
+	int x = x0, d1, d2;
+
+#ifdef __SSE2__
+	/* eight samples per step; lanes of the wrong parity are masked out */
+	const __m128i zero = _mm_setzero_si128 ();
+	const __m128i mask = ((x0 & 1) == gp) ?
+		_mm_set_epi16 (0, -1, 0, -1, 0, -1, 0, -1) :
+		_mm_set_epi16 (-1, 0, -1, 0, -1, 0, -1, 0);
+	__m128i acc = zero;
+	int i, lanes[4];
+
+	for (; x + 8 <= x1; x += 8) {
+		__m128i c  = _mm_unpacklo_epi8 (_mm_loadl_epi64 ((const __m128i *) (a + x)), zero);
+		__m128i ne = _mm_unpacklo_epi8 (_mm_loadl_epi64 ((const __m128i *) (b + x + 1)), zero);
+		__m128i nw = _mm_unpacklo_epi8 (_mm_loadl_epi64 ((const __m128i *) (b + x - 1)), zero);
+		__m128i d  = _mm_and_si128 (_mm_sub_epi16 (c, ne), mask);
+		__m128i e  = _mm_and_si128 (_mm_sub_epi16 (c, nw), mask);
+		acc = _mm_add_epi32 (acc, _mm_madd_epi16 (d, d));
+		acc = _mm_add_epi32 (acc, _mm_madd_epi16 (e, e));
+	}
+	_mm_storeu_si128 ((__m128i *) lanes, acc);
+	for (i = 0; i < 4; i++)
+		energy += lanes[i];
+#endif
+
+	if ((x & 1) != gp)
+		x++;
+	for (; x < x1; x += 2) {
+		d1 = a[x] - b[x + 1];
+		d2 = a[x] - b[x - 1];
+		energy += d1 * d1 + d2 * d2;
+	}
+
+	return (energy);
+}
+
+double
+gp_bayer_focus (const unsigned char *input, int w, int h, BayerTile tile,
+		int x0, int y0, int roi_w, int roi_h)
+{
+	int x1 = x0 + roi_w, y1 = y0 + roi_h;
+	int y, gp;
+	double energy = 0.0, n = 0.0;
+
+	if (tile > BAYER_TILE_GBRG)
+		return (-1.0);
+
+	/* diagonal neighbours need one column of margin on each side */
+	if (x0 < 1)
+		x0 = 1;
+	if (x1 > w - 1)
+		x1 = w - 1;
+	if (y0 < 0)
+		y0 = 0;
+	if (y1 > h)
+		y1 = h;
+
+	for (y = y0; y < y1 - 1; y++) {
+		gp = (gp_bayer_colour (tile, 0, y) == GREEN) ? 0 : 1;
+		energy += green_energy_row (input + y * w, input + (y + 1) * w, x0, x1, gp);
+		n += (x1 - x0 + ((x0 & 1) == gp)) / 2;
+	}
+
+	if (n <= 0.0)
+		return (0.0);
+	return (energy / (2.0 * n));
+}
+
+int
+gp_bayer_focus_grid (const unsigned char *input, int w, int h, BayerTile tile,
+		     int cols, int rows, double *metrics)
+{
+	int i;
+
+	if (tile > BAYER_TILE_GBRG || cols < 1 || rows < 1)
+		return (-1);
+
+#pragma omp parallel for schedule(dynamic)
+	for (i = 0; i < cols * rows; i++) {
+		int c = i % cols, r = i / cols;
+		int x0 = c * w / cols, y0 = r * h / rows;
+		metrics[i] = gp_bayer_focus (input, w, h, tile, x0, y0,
+					     (c + 1) * w / cols - x0,
+					     (r + 1) * h / rows - y0);
+	}
+
+	return (0);
+}
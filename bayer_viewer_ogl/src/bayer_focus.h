@@ -0,0 +1,20 @@
+/**
+ * @file   bayer_focus.h
+ * @brief  Focus metrics computed on the green samples of Bayer pattern images.
+ *
+ * The metric is the mean squared difference between each green sample
+ * and its two diagonal green neighbours on the next row, i.e. gradient
+ * energy on the green quincunx.  No RGB image is produced.
+ */
+
+#ifndef __BAYER_FOCUS_H__
+#define __BAYER_FOCUS_H__
+
+#include "bayer.h"
+
+double gp_bayer_focus (const unsigned char *input, int w, int h, BayerTile tile,
+		       int x0, int y0, int roi_w, int roi_h);
+int gp_bayer_focus_grid (const unsigned char *input, int w, int h, BayerTile tile,
+			 int cols, int rows, double *metrics);
+
+#endif /* __BAYER_FOCUS_H__ */
@@ -0,0 +1,151 @@
+/**
+ * @file   bayer_gradient.cpp
+ * @brief  Gradient-corrected interpolation of Bayer pattern images.
+ */
+
+#include "bayer_gradient.h"
+#include "bayer_sample.h"
+
+/* native sample at (x, y) of the expanded image, mirrored at the edges */
+static inline int
+sample (const unsigned char *image, int w, int h, int x, int y, BayerTile tile)
+{
+	x = bayer_mirror (x, w);
+	y = bayer_mirror (y, h);
+	return (image[(y * w + x) * 3 + gp_bayer_colour (tile, x, y)]);
+}
+
+/*
+ * Fills in the missing colours of pixel out, given its own sample c of
+ * colour c, the samples one (n, s, w, e) and two (n2, s2, w2, e2) pixels
+ * away and the diagonal sum diag.  At green pixels hc and vc are the
+ * colours sampled along the row and the column.
+ */
+static inline void
+gradient_pixel (unsigned char *out, int colour, int hc, int vc, int c,
+		int n, int s, int w, int e, int n2, int s2, int w2, int e2, int diag)
+{
+	if (colour == 1) {
+		out[hc] = bayer_clamp ((10 * c + 8 * (w + e) - 2 * (w2 + e2 + diag)
+				        + n2 + s2 + 8) >> 4);
+		out[vc] = bayer_clamp ((10 * c + 8 * (n + s) - 2 * (n2 + s2 + diag)
+				        + w2 + e2 + 8) >> 4);
+	} else {
+		out[1] = bayer_clamp ((8 * c + 4 * (n + s + w + e) - 2 * (n2 + s2 + w2 + e2)
+				       + 8) >> 4);
+		out[2 - colour] = bayer_clamp ((12 * c + 4 * diag - 3 * (n2 + s2 + w2 + e2)
+					        + 8) >> 4);
+	}
+}
+
+/*
+ * Interpolates the rectangle [x0, x1) x [y0, y1) of an image expanded
+ * by gp_bayer_expand.  Reads the native samples of a
+ * BAYER_GRADIENT_HALO border around it and writes only the missing
+ * colours inside it, so disjoint rectangles may be interpolated
+ * concurrently.
+ */
+int
+gp_bayer_gradient_rect (unsigned char *image, int w, int h, int x0, int y0,
+			int x1, int y1, BayerTile tile)
+{
+	int x, y, colour, hc, vc, a, b, d;
+	int r = w * 3;
+	unsigned char *q;
+
+	if (tile > BAYER_TILE_GBRG)
+		return (-1);
+	if (x1 > w)
+		x1 = w;
+	if (y1 > h)
+		y1 = h;
+
+	for (y = y0; y < y1; y++) {
+		for (x = x0; x < x1; x++) {
+			q = image + (y * w + x) * 3;
+			colour = gp_bayer_colour (tile, x, y);
+			hc = gp_bayer_colour (tile, x + 1, y);
+			vc = gp_bayer_colour (tile, x, y + 1);
+			if (x < 2 || x >= w - 2 || y < 2 || y >= h - 2) {
+				gradient_pixel (q, colour, hc, vc, q[colour],
+						sample (image, w, h, x, y - 1, tile),
+						sample (image, w, h, x, y + 1, tile),
+						sample (image, w, h, x - 1, y, tile),
+						sample (image, w, h, x + 1, y, tile),
+						sample (image, w, h, x, y - 2, tile),
+						sample (image, w, h, x, y + 2, tile),
+						sample (image, w, h, x - 2, y, tile),
+						sample (image, w, h, x + 2, y, tile),
+						sample (image, w, h, x - 1, y - 1, tile) +
+						sample (image, w, h, x + 1, y - 1, tile) +
+						sample (image, w, h, x - 1, y + 1, tile) +
+						sample (image, w, h, x + 1, y + 1, tile));
+				continue;
+			}
+			/* channels sampled across (a), along (b) and diagonally (d) */
+			a = (colour == 1) ? hc : 1;
+			b = (colour == 1) ? vc : 1;
+			d = (colour == 1) ? 1 : 2 - colour;
+			gradient_pixel (q, colour, hc, vc, q[colour],
+					q[b - r], q[b + r], q[a - 3], q[a + 3],
+					q[colour - 2 * r], q[colour + 2 * r],
+					q[colour - 6], q[colour + 6],
+					q[d - r - 3] + q[d - r + 3] + q[d + r - 3] + q[d + r + 3]);
+		}
+	}
+
+	return (0);
+}
+
+/*
+ * Mean absolute difference between same-colour samples two pixels
+ * apart, horizontally plus vertically, over [x0, x1) x [y0, y1) of an
+ * expanded image.  Low in flat regions, high at edges and in texture.
+ * Only every other pair of rows is measured, which covers all four
+ * quad positions at half the cost.
+ */
+int
+gp_bayer_gradient_energy (const unsigned char *image, int w, int h, int x0, int y0,
+			  int x1, int y1, BayerTile tile)
+{
+	int x, y, v, d, i;
+	int colour[2];
+	unsigned long sum = 0, count = 0;
+	const unsigned char *q;
+
+	if (tile > BAYER_TILE_GBRG)
+		return (-1);
+	if (x0 < 0)
+		x0 = 0;
+	if (y0 < 0)
+		y0 = 0;
+	if (x1 > w - 2)
+		x1 = w - 2;
+	if (y1 > h - 2)
+		y1 = h - 2;
+	if (x1 <= x0)
+		return (0);
+
+	for (y = y0; y < y1; y++) {
+		if ((y - y0) & 2)
+			continue;
+		/* channels of the even and odd columns of this row */
+		colour[x0 & 1] = gp_bayer_colour (tile, x0, y);
+		colour[(x0 + 1) & 1] = gp_bayer_colour (tile, x0 + 1, y);
+		for (i = 0; i < 2; i++) {
+			q = image + (y * w + x0 + i) * 3 + colour[(x0 + i) & 1];
+			for (x = x0 + i; x < x1; x += 2, q += 6) {
+				v = q[0];
+				d = v - q[6];
+				sum += (d < 0) ? -d : d;
+				d = v - q[6 * w];
+				sum += (d < 0) ? -d : d;
+			}
+		}
+		count += x1 - x0;
+	}
+
+	if (count == 0)
+		return (0);
+	return (static_cast<int>(sum / count));
+}
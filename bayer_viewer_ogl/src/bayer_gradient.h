@@ -0,0 +1,24 @@
+/**
+ * @file   bayer_gradient.h
+ * @brief  Gradient-corrected interpolation of Bayer pattern images.
+ *
+ * The 5x5 linear kernels of Malvar, He and Cutler: each bilinear
+ * estimate is corrected by the Laplacian of the channel sampled at the
+ * pixel, which removes most of the colour fringing bilinear leaves at
+ * edges for about three times its cost.
+ */
+
+#ifndef __BAYER_GRADIENT_H__
+#define __BAYER_GRADIENT_H__
+
+#include "bayer.h"
+
+/* Rows and columns of native samples read around the interpolated area. */
+#define BAYER_GRADIENT_HALO 2
+
+int gp_bayer_gradient_rect (unsigned char *image, int w, int h, int x0, int y0,
+			    int x1, int y1, BayerTile tile);
+int gp_bayer_gradient_energy (const unsigned char *image, int w, int h, int x0, int y0,
+			      int x1, int y1, BayerTile tile);
+
+#endif /* __BAYER_GRADIENT_H__ */
@@ -0,0 +1,209 @@
+/**
+ * @file   bayer_pipeline.cpp
+ * @brief  Demosaicing with optional stages fused into the CFA read.
+ */
+
+#include <cstddef>
+#include "bayer_pipeline.h"
+#include "bayer_strip.h"
+
+void
+gp_bayer_pipeline_init (BayerPipeline *pipeline)
+{
+	pipeline->method = BAYER_METHOD_BILINEAR;
+	pipeline->adaptive_threshold = BAYER_ADAPTIVE_THRESHOLD;
+	pipeline->denoise = 0;
+	pipeline->defects = NULL;
+	pipeline->shading = NULL;
+	pipeline->stats = NULL;
+	pipeline->sharpen = 0.0f;
+	pipeline->pyramid = NULL;
+}
+
+/*
+ * Interpolates pixels [x0, x1) x [y0, y1) of the expanded image with one
+ * of the single-pass methods.  Adaptive blocks are aligned to multiples
+ * of #BAYER_ADAPTIVE_BLOCK columns and classified on the differences
+ * reaching into the kernel halo on every side, so an edge on a block
+ * boundary selects the gradient kernel on both sides of it.  Returns -1
+ * for the methods that need passes over the whole image.
+ */
+int
+gp_bayer_method_rect (unsigned char *image, int w, int h, int x0, int y0, int x1, int y1,
+		      BayerTile tile, BayerMethod method, int adaptive_threshold)
+{
+	int bx0, bx1, energy;
+
+	switch (method) {
+	case BAYER_METHOD_BILINEAR:
+		return (gp_bayer_interpolate_rect (image, w, h, x0, y0, x1, y1, tile));
+	case BAYER_METHOD_GRADIENT:
+		return (gp_bayer_gradient_rect (image, w, h, x0, y0, x1, y1, tile));
+	case BAYER_METHOD_ADAPTIVE:
+		if (x1 > w)
+			x1 = w;
+		for (bx0 = x0; bx0 < x1; bx0 = bx1) {
+			bx1 = (bx0 / BAYER_ADAPTIVE_BLOCK + 1) * BAYER_ADAPTIVE_BLOCK;
+			if (bx1 > x1)
+				bx1 = x1;
+			energy = gp_bayer_gradient_energy (image, w, h,
+							   bx0 - BAYER_GRADIENT_HALO,
+							   y0 - BAYER_GRADIENT_HALO,
+							   bx1, y1, tile);
+			if (energy < adaptive_threshold)
+				gp_bayer_interpolate_rect (image, w, h, bx0, y0, bx1, y1, tile);
+			else
+				gp_bayer_gradient_rect (image, w, h, bx0, y0, bx1, y1, tile);
+		}
+		return (0);
+	case BAYER_METHOD_SUPERPIXEL:
+		return (gp_bayer_superpixel_rect (image, w, h, x0, y0, x1, y1, tile));
+	default:
+		return (-1);
+	}
+}
+
+/* Interpolates rows [y0, y1) of the expanded image with the pipeline's method. */
+static void
+interpolate_rows (unsigned char *image, int w, int h, int y0, int y1,
+		  BayerTile tile, const BayerPipeline *pipeline)
+{
+	switch (pipeline->method) {
+	case BAYER_METHOD_EDGE:
+		gp_bayer_edge_colour_rows (image, w, h, y0, y1, tile);
+		break;
+	case BAYER_METHOD_AHD:
+		/* done in tiles before the strips */
+		break;
+	default:
+		gp_bayer_method_rect (image, w, h, 0, y0, w, y1, tile,
+				      pipeline->method, pipeline->adaptive_threshold);
+		break;
+	}
+}
+
+int
+gp_bayer_decode_pipeline (const unsigned char *input, int w, int h, unsigned char *output,
+			  BayerTile tile, const BayerPipeline *pipeline)
+{
+	int s, i, y0, rows, m;
+	int strips = bayer_strip_count (h);
+	int threads = bayer_strip_threads ();
+	BayerStats *partial = NULL;
+	unsigned char *luma = NULL;
+	BayerPyramid *pyramid = pipeline->pyramid;
+
+	if (tile > BAYER_TILE_GBRG && (pipeline->method != BAYER_METHOD_BILINEAR ||
+				       pipeline->denoise || pipeline->defects ||
+				       pipeline->shading || pipeline->stats ||
+				       (pyramid && pyramid->from_cfa)))
+		return (-1);
+	if (pipeline->defects && (pipeline->defects->w != w || pipeline->defects->h != h))
+		return (-1);
+
+	/* one statistics partial per thread, merged once all strips are done */
+	if (pipeline->stats) {
+		partial = new BayerStats[threads];
+		for (i = 0; i < threads; i++)
+			gp_bayer_stats_init (&partial[i], pipeline->stats->step,
+					     pipeline->stats->saturation);
+	}
+
+#pragma omp parallel for private(y0, rows) schedule(dynamic)
+	for (s = 0; s < strips; s++) {
+		y0 = s * BAYER_STRIP_ROWS;
+		rows = (y0 + BAYER_STRIP_ROWS > h) ? h - y0 : BAYER_STRIP_ROWS;
+		gp_bayer_expand (input + y0 * w, w, rows, output + y0 * w * 3, tile);
+		/* defects are corrected first, inside denoising when it is on */
+		if (pipeline->denoise > 0)
+			gp_bayer_denoise_rows (input, w, h, y0, y0 + rows, pipeline->denoise,
+					       pipeline->defects, output, tile);
+		else if (pipeline->defects)
+			gp_bayer_defects_correct_rows (pipeline->defects, input, w, h,
+						       y0, y0 + rows, output, tile);
+		if (pipeline->shading)
+			gp_bayer_shading_apply_rows (pipeline->shading, w, h,
+						     y0, y0 + rows, output, tile);
+		if (partial)
+			gp_bayer_stats_rows (input, w, h, y0, y0 + rows, tile,
+					     &partial[bayer_strip_thread ()]);
+		if (pyramid && pyramid->from_cfa)
+			gp_bayer_pyramid_rows (pyramid, output, w, h, y0, y0 + rows, tile);
+	}
+
+	if (partial) {
+		gp_bayer_stats_clear (pipeline->stats);
+		for (i = 0; i < threads; i++)
+			gp_bayer_stats_merge (pipeline->stats, &partial[i]);
+		delete [] partial;
+	}
+
+	/*
+	 * Interpolate strip by strip.  Sharpening follows on the rows just
+	 * interpolated, except for the m rows at each end of a strip, m
+	 * being the reach of the interpolation kernel: their samples must
+	 * stay unsharpened until the neighbouring strips have interpolated,
+	 * and the outermost need luma from those strips, so they are
+	 * sharpened once every strip is done.  A strip's pyramid rows are
+	 * made as soon as its last rows are final, unless they were made
+	 * from the CFA already.
+	 */
+	if (pyramid && pyramid->from_cfa)
+		pyramid = NULL;
+	m = (pipeline->method == BAYER_METHOD_GRADIENT ||
+	     pipeline->method == BAYER_METHOD_ADAPTIVE) ? BAYER_GRADIENT_HALO : 1;
+	if (pipeline->sharpen != 0.0f)
+		luma = new unsigned char[w * h];
+
+	/* edge-directed red and blue need the green of the neighbouring strips */
+	if (pipeline->method == BAYER_METHOD_EDGE) {
+#pragma omp parallel for private(y0, rows) schedule(dynamic)
+		for (s = 0; s < strips; s++) {
+			y0 = s * BAYER_STRIP_ROWS;
+			rows = (y0 + BAYER_STRIP_ROWS > h) ? h - y0 : BAYER_STRIP_ROWS;
+			gp_bayer_edge_green_rows (output, w, h, y0, y0 + rows, tile);
+		}
+	}
+
+	/* AHD works on square tiles with a wide halo rather than on strips */
+	if (pipeline->method == BAYER_METHOD_AHD &&
+	    gp_bayer_ahd (output, w, h, tile) < 0)
+		gp_bayer_interpolate_rows (output, w, h, 0, h, tile);
+
+#pragma omp parallel for private(y0, rows) schedule(dynamic)
+	for (s = 0; s < strips; s++) {
+		y0 = s * BAYER_STRIP_ROWS;
+		rows = (y0 + BAYER_STRIP_ROWS > h) ? h - y0 : BAYER_STRIP_ROWS;
+		interpolate_rows (output, w, h, y0, y0 + rows, tile, pipeline);
+		if (luma) {
+			gp_bayer_luma_rows (output, w, y0, y0 + rows, luma);
+			if (rows > 2 * m)
+				gp_bayer_sharpen_rows (output, luma, w, h, y0 + m,
+						       y0 + rows - m, pipeline->sharpen);
+		} else if (pyramid) {
+			gp_bayer_pyramid_rows (pyramid, output, w, h, y0, y0 + rows, tile);
+		}
+	}
+
+	if (luma) {
+#pragma omp parallel for private(y0, rows) schedule(dynamic)
+		for (s = 0; s < strips; s++) {
+			y0 = s * BAYER_STRIP_ROWS;
+			rows = (y0 + BAYER_STRIP_ROWS > h) ? h - y0 : BAYER_STRIP_ROWS;
+			if (rows > 2 * m) {
+				gp_bayer_sharpen_rows (output, luma, w, h, y0, y0 + m,
+						       pipeline->sharpen);
+				gp_bayer_sharpen_rows (output, luma, w, h, y0 + rows - m,
+						       y0 + rows, pipeline->sharpen);
+			} else {
+				gp_bayer_sharpen_rows (output, luma, w, h, y0, y0 + rows,
+						       pipeline->sharpen);
+			}
+			if (pyramid)
+				gp_bayer_pyramid_rows (pyramid, output, w, h, y0, y0 + rows, tile);
+		}
+		delete [] luma;
+	}
+
+	return (0);
+}
@@ -0,0 +1,65 @@
+/**
+ * @file   bayer_pipeline.h
+ * @brief  Demosaicing with optional stages fused into the CFA read.
+ *
+ * gp_bayer_decode_pipeline expands the CFA strip by strip and runs the
+ * enabled stages on each strip while it is still in cache, so none of
+ * them needs its own pass over the frame.  The strips are then
+ * interpolated, and optionally sharpened, the same way.  With no
+ * stages enabled and bilinear interpolation it is equivalent to
+ * gp_bayer_decode.
+ *
+ * BAYER_METHOD_ADAPTIVE splits each strip into blocks of
+ * #BAYER_ADAPTIVE_BLOCK columns and interpolates flat blocks bilinearly
+ * and textured ones with the gradient-corrected kernel.  Both kernels
+ * read only native samples, so block boundaries need no blending.
+ */
+
+#ifndef __BAYER_PIPELINE_H__
+#define __BAYER_PIPELINE_H__
+
+#include "bayer.h"
+#include "bayer_ahd.h"
+#include "bayer_defects.h"
+#include "bayer_denoise.h"
+#include "bayer_edge.h"
+#include "bayer_gradient.h"
+#include "bayer_pyramid.h"
+#include "bayer_shading.h"
+#include "bayer_sharpen.h"
+#include "bayer_stats.h"
+#include "bayer_superpixel.h"
+
+/* Columns per block classified by BAYER_METHOD_ADAPTIVE. */
+#define BAYER_ADAPTIVE_BLOCK 32
+
+/* Default gradient energy above which adaptive blocks use the gradient kernel. */
+#define BAYER_ADAPTIVE_THRESHOLD 12
+
+typedef enum {
+	BAYER_METHOD_BILINEAR = 0,	/* gp_bayer_interpolate */
+	BAYER_METHOD_GRADIENT,		/* gradient-corrected, everywhere */
+	BAYER_METHOD_ADAPTIVE,		/* gradient-corrected where textured */
+	BAYER_METHOD_SUPERPIXEL,	/* one colour per 2x2 quad */
+	BAYER_METHOD_EDGE,		/* edge-directed (Hamilton-Adams) */
+	BAYER_METHOD_AHD		/* homogeneity-directed, for stills */
+} BayerMethod;
+
+typedef struct {
+	BayerMethod method;		/* interpolation kernel */
+	int adaptive_threshold;		/* gradient energy for BAYER_METHOD_ADAPTIVE */
+	int denoise;			/* CFA pre-filter range threshold, 0 = off */
+	const BayerDefects *defects;	/* corrected before denoising, or NULL; must match w x h */
+	const BayerShading *shading;	/* lens-shading gains, or NULL */
+	BayerStats *stats;		/* gathered from the raw CFA, or NULL */
+	float sharpen;			/* unsharp-mask amount on luma, 0 = off */
+	BayerPyramid *pyramid;		/* reduced copies of the output, or NULL */
+} BayerPipeline;
+
+void gp_bayer_pipeline_init (BayerPipeline *pipeline);
+int gp_bayer_method_rect (unsigned char *image, int w, int h, int x0, int y0, int x1, int y1,
+			  BayerTile tile, BayerMethod method, int adaptive_threshold);
+int gp_bayer_decode_pipeline (const unsigned char *input, int w, int h, unsigned char *output,
+			      BayerTile tile, const BayerPipeline *pipeline);
+
+#endif /* __BAYER_PIPELINE_H__ */
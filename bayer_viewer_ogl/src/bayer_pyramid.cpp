@@ -0,0 +1,131 @@
+/**
+ * @file   bayer_pyramid.cpp
+ * @brief  Reduced-resolution copies of a demosaiced image.
+ */
+
+#include <cstddef>
+#include "bayer_pyramid.h"
+
+/*
+ * Creates a pyramid of up to levels levels below a w x h image, fewer
+ * if the image is too small to halve that often.
+ */
+BayerPyramid *
+gp_bayer_pyramid_new (int w, int h, int levels)
+{
+	BayerPyramid *pyramid;
+	int k;
+
+	if (levels > BAYER_PYRAMID_LEVELS)
+		levels = BAYER_PYRAMID_LEVELS;
+	while (levels > 0 && ((w >> levels) < 1 || (h >> levels) < 1))
+		levels--;
+	if (levels < 1)
+		return (NULL);
+
+	pyramid = new BayerPyramid;
+	pyramid->levels = levels;
+	pyramid->from_cfa = 0;
+	for (k = 0; k < BAYER_PYRAMID_LEVELS; k++) {
+		pyramid->w[k] = (k < levels) ? w >> (k + 1) : 0;
+		pyramid->h[k] = (k < levels) ? h >> (k + 1) : 0;
+		pyramid->level[k] = (k < levels) ? new unsigned char[pyramid->w[k] * pyramid->h[k] * 3] : NULL;
+	}
+
+	return (pyramid);
+}
+
+void
+gp_bayer_pyramid_free (BayerPyramid *pyramid)
+{
+	int k;
+
+	if (pyramid == NULL)
+		return;
+	for (k = 0; k < pyramid->levels; k++)
+		delete [] pyramid->level[k];
+	delete pyramid;
+}
+
+/* averages 2x2 blocks of rows [y0, y1) of a w x h RGB image into the next level */
+static void
+halve_rows (const unsigned char *image, int w, int y0, int y1,
+	    unsigned char *out, int ow, int oh)
+{
+	int x, y, c;
+	const unsigned char *a, *b;
+	unsigned char *q;
+
+	for (y = y0 / 2; y < y1 / 2 && y < oh; y++) {
+		a = image + 2 * y * w * 3;
+		b = a + w * 3;
+		q = out + y * ow * 3;
+		for (x = 0; x < ow * 3; x += 3)
+			for (c = 0; c < 3; c++)
+				q[x + c] = (a[2 * x + c] + a[2 * x + 3 + c] +
+					    b[2 * x + c] + b[2 * x + 3 + c] + 2) >> 2;
+	}
+}
+
+/* makes the quads of rows [y0, y1) of an expanded CFA into one pixel each */
+static void
+quad_rows (const unsigned char *image, int w, int y0, int y1, BayerTile tile,
+	   unsigned char *out, int ow, int oh)
+{
+	int x, y, i, colour[4];
+	const unsigned char *a, *b;
+	unsigned char *q;
+
+	for (i = 0; i < 4; i++)
+		colour[i] = gp_bayer_colour (tile, i & 1, i >> 1);
+
+	for (y = y0 / 2; y < y1 / 2 && y < oh; y++) {
+		a = image + 2 * y * w * 3;
+		b = a + w * 3;
+		q = out + y * ow * 3;
+		for (x = 0; x < ow; x++) {
+			int rgb[3] = {0, 0, 0};
+
+			rgb[colour[0]] += a[6 * x + colour[0]];
+			rgb[colour[1]] += a[6 * x + 3 + colour[1]];
+			rgb[colour[2]] += b[6 * x + colour[2]];
+			rgb[colour[3]] += b[6 * x + 3 + colour[3]];
+			q[3 * x + 0] = rgb[0];
+			q[3 * x + 1] = (rgb[1] + 1) >> 1;
+			q[3 * x + 2] = rgb[2];
+		}
+	}
+}
+
+/*
+ * Fills in the rows of every level made from rows [y0, y1) of image:
+ * the demosaiced image, or with from_cfa the image expanded by
+ * gp_bayer_expand (only its native samples are read).  y0 must be a
+ * multiple of 2^levels, as the strips of gp_bayer_decode_pipeline are,
+ * so that disjoint row ranges fill disjoint rows of each level.
+ */
+int
+gp_bayer_pyramid_rows (BayerPyramid *pyramid, const unsigned char *image,
+		       int w, int h, int y0, int y1, BayerTile tile)
+{
+	int k;
+
+	if (pyramid->from_cfa && tile > BAYER_TILE_GBRG)
+		return (-1);
+	if (y0 % (1 << pyramid->levels))
+		return (-1);
+	if (y1 > h)
+		y1 = h;
+
+	if (pyramid->from_cfa)
+		quad_rows (image, w, y0, y1, tile,
+			   pyramid->level[0], pyramid->w[0], pyramid->h[0]);
+	else
+		halve_rows (image, w, y0, y1,
+			    pyramid->level[0], pyramid->w[0], pyramid->h[0]);
+	for (k = 1; k < pyramid->levels; k++)
+		halve_rows (pyramid->level[k - 1], pyramid->w[k - 1], y0 >> k, y1 >> k,
+			    pyramid->level[k], pyramid->w[k], pyramid->h[k]);
+
+	return (0);
+}
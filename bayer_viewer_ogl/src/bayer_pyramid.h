@@ -0,0 +1,41 @@
+/**
+ * @file   bayer_pyramid.h
+ * @brief  Reduced-resolution copies of a demosaiced image.
+ *
+ * Level k is the image box-filtered to 1/2^k of its width and height,
+ * each pixel the mean of a 2x2 block of level k - 1.  Rows or columns
+ * left over at odd sizes are dropped.  The levels are built strip by
+ * strip as part of gp_bayer_decode_pipeline, while the rows they are
+ * made from are still in cache.  A strip of #BAYER_STRIP_ROWS rows
+ * covers whole rows of every level, so there are at most
+ * #BAYER_PYRAMID_LEVELS.
+ *
+ * With from_cfa set, the first level is made from the CFA quads instead:
+ * their red and blue samples and the mean of their greens.  It needs no
+ * interpolated samples, so it is ready before interpolation starts, and
+ * it has none of the interpolation's blur.
+ */
+
+#ifndef __BAYER_PYRAMID_H__
+#define __BAYER_PYRAMID_H__
+
+#include "bayer.h"
+
+/* Most levels below full resolution (1/2 to 1/16). */
+#define BAYER_PYRAMID_LEVELS 4
+
+typedef struct {
+	int levels;			/* levels below full resolution */
+	int from_cfa;			/* make level 1 from the CFA quads */
+	int w[BAYER_PYRAMID_LEVELS];	/* size of level k + 1 */
+	int h[BAYER_PYRAMID_LEVELS];
+	unsigned char *level[BAYER_PYRAMID_LEVELS];	/* RGB, level k + 1 */
+} BayerPyramid;
+
+BayerPyramid *gp_bayer_pyramid_new (int w, int h, int levels);
+void gp_bayer_pyramid_free (BayerPyramid *pyramid);
+
+int gp_bayer_pyramid_rows (BayerPyramid *pyramid, const unsigned char *image,
+			   int w, int h, int y0, int y1, BayerTile tile);
+
+#endif /* __BAYER_PYRAMID_H__ */
@@ -0,0 +1,27 @@
+/**
+ * @file   bayer_sample.h
+ * @brief  Helpers for reading and writing samples of Bayer pattern images.
+ */
+
+#ifndef __BAYER_SAMPLE_H__
+#define __BAYER_SAMPLE_H__
+
+/* Clamps an interpolated value to a sample. */
+static inline unsigned char
+bayer_clamp (int v)
+{
+	return ((v < 0) ? 0 : (v > 255) ? 255 : v);
+}
+
+/* Mirrors a coordinate into [0, n), keeping its parity. */
+static inline int
+bayer_mirror (int i, int n)
+{
+	if (i < 0)
+		i = -i;
+	if (i >= n)
+		i = 2 * (n - 1) - i;
+	return ((i < 0) ? 0 : (i >= n) ? n - 1 : i);
+}
+
+#endif /* __BAYER_SAMPLE_H__ */
@@ -0,0 +1,130 @@
+/**
+ * @file   bayer_shading.cpp
+ * @brief  Lens-shading (vignetting) correction for Bayer pattern images.
+ */
+
+#include <cstddef>
+#include "bayer_shading.h"
+
+#define RED 0
+#define GREEN 1
+
+/* Creates a grid_w x grid_h shading grid with all gains set to 1. */
+BayerShading *
+gp_bayer_shading_new (int grid_w, int grid_h)
+{
+	BayerShading *shading;
+	int p, i;
+
+	if (grid_w < 1 || grid_h < 1 || grid_w > BAYER_SHADING_MAX_GRID)
+		return (NULL);
+
+	shading = new BayerShading;
+	shading->grid_w = grid_w;
+	shading->grid_h = grid_h;
+	for (p = 0; p < 4; p++) {
+		shading->gain[p] = new float[grid_w * grid_h];
+		for (i = 0; i < grid_w * grid_h; i++)
+			shading->gain[p][i] = 1.0f;
+	}
+
+	return (shading);
+}
+
+void
+gp_bayer_shading_free (BayerShading *shading)
+{
+	int p;
+
+	if (shading == NULL)
+		return;
+	for (p = 0; p < 4; p++)
+		delete [] shading->gain[p];
+	delete shading;
+}
+
+/*
+ * Writes the grids as grid_w x grid_h RGBA gains in bayer_cg's layout:
+ * red, the greens in rows of blue, blue, the greens in rows of red.
+ * Rows are those of the tile as laid out in memory.
+ */
+int
+gp_bayer_shading_rgba (const BayerShading *shading, BayerTile tile, float *rgba)
+{
+	int n = shading->grid_w * shading->grid_h;
+	int p, i, px, py, colour, channel;
+
+	if (tile > BAYER_TILE_GBRG)
+		return (-1);
+
+	for (p = 0; p < 4; p++) {
+		px = p & 1;
+		py = p >> 1;
+		colour = gp_bayer_colour (tile, px, py);
+		if (colour != GREEN)
+			channel = colour;
+		else if (gp_bayer_colour (tile, px ^ 1, py) == RED)
+			channel = 3;
+		else
+			channel = 1;
+		for (i = 0; i < n; i++)
+			rgba[i * 4 + channel] = shading->gain[p][i];
+	}
+
+	return (0);
+}
+
+/* position of pixel i of n on a grid of m nodes, split into node and weight */
+static void
+grid_position (int i, int n, int m, int *node, float *t)
+{
+	float f = (n > 1 && m > 1) ? (float) i * (m - 1) / (n - 1) : 0.0f;
+
+	*node = (int) f;
+	if (*node >= m - 1) {
+		*node = (m > 1) ? m - 2 : 0;
+		*t = (m > 1) ? 1.0f : 0.0f;
+	} else {
+		*t = f - *node;
+	}
+}
+
+/*
+ * Multiplies the samples of rows [y0, y1) in the expanded image output
+ * by their upsampled gain.  Each row first interpolates the two grids
+ * it uses vertically, then every sample interpolates horizontally.
+ */
+int
+gp_bayer_shading_apply_rows (const BayerShading *shading, int w, int h, int y0, int y1,
+			     unsigned char *output, BayerTile tile)
+{
+	int gw = shading->grid_w, gh = shading->grid_h;
+	int x, y, i, j, k, p, v, colour[2];
+	float t, g, row[2 * BAYER_SHADING_MAX_GRID];
+	const float *a, *b;
+
+	if (tile > BAYER_TILE_GBRG || gw > BAYER_SHADING_MAX_GRID)
+		return (-1);
+	if (y1 > h)
+		y1 = h;
+
+	for (y = y0; y < y1; y++) {
+		grid_position (y, h, gh, &j, &t);
+		for (k = 0; k < 2; k++) {
+			p = 2 * (y & 1) + k;
+			a = shading->gain[p] + j * gw;
+			b = (gh > 1) ? a + gw : a;
+			for (i = 0; i < gw; i++)
+				row[k * gw + i] = a[i] + t * (b[i] - a[i]);
+			colour[k] = gp_bayer_colour (tile, k, y);
+		}
+		for (x = 0; x < w; x++) {
+			grid_position (x, w, gw, &i, &t);
+			a = row + (x & 1) * gw + i;
+			g = (gw > 1) ? a[0] + t * (a[1] - a[0]) : a[0];
+			v = (int) (output[(y * w + x) * 3 + colour[x & 1]] * g + 0.5f);
+			output[(y * w + x) * 3 + colour[x & 1]] = (v > 255) ? 255 : (v < 0) ? 0 : v;
+		}
+	}
+	return (0);
+}
@@ -0,0 +1,37 @@
+/**
+ * @file   bayer_shading.h
+ * @brief  Lens-shading (vignetting) correction for Bayer pattern images.
+ *
+ * Gains are given on a coarse grid, one grid per position in the 2x2
+ * CFA quad, and bilinearly upsampled to the image as it is corrected.
+ * Grid nodes lie evenly spaced from the first to the last pixel, so the
+ * corner nodes sit on the corner pixels.
+ *
+ * bayer_cg's BayerRenderer::SetShading takes the same grids by colour
+ * instead, interleaved as RGBA: red, green in rows of blue, blue, green
+ * in rows of red.  gp_bayer_shading_rgba converts for a given tile, so
+ * one calibration feeds both.
+ */
+
+#ifndef __BAYER_SHADING_H__
+#define __BAYER_SHADING_H__
+
+#include "bayer.h"
+
+/* Widest grid; each row's interpolated gains are kept on the stack. */
+#define BAYER_SHADING_MAX_GRID 256
+
+typedef struct {
+	int grid_w, grid_h;
+	float *gain[4];		/* grid_w x grid_h gains for quad positions
+				   (0,0), (1,0), (0,1) and (1,1) */
+} BayerShading;
+
+BayerShading *gp_bayer_shading_new (int grid_w, int grid_h);
+void gp_bayer_shading_free (BayerShading *shading);
+int gp_bayer_shading_rgba (const BayerShading *shading, BayerTile tile, float *rgba);
+
+int gp_bayer_shading_apply_rows (const BayerShading *shading, int w, int h, int y0, int y1,
+				 unsigned char *output, BayerTile tile);
+
+#endif /* __BAYER_SHADING_H__ */
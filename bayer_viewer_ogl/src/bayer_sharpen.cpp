@@ -0,0 +1,62 @@
+/**
+ * @file   bayer_sharpen.cpp
+ * @brief  Unsharp masking of demosaiced images on luma.
+ */
+
+#include "bayer_sharpen.h"
+#include "bayer_sample.h"
+
+/* Computes the luma of rows [y0, y1) of rgb into the w-wide plane luma. */
+void
+gp_bayer_luma_rows (const unsigned char *rgb, int w, int y0, int y1,
+		    unsigned char *luma)
+{
+	const unsigned char *p = rgb + y0 * w * 3;
+	unsigned char *l = luma + y0 * w;
+	int i;
+
+	for (i = 0; i < (y1 - y0) * w; i++, p += 3)
+		l[i] = (77 * p[0] + 150 * p[1] + 29 * p[2] + 128) >> 8;
+}
+
+/*
+ * Sharpens rows [y0, y1) of rgb in place.  Reads luma of rows y0-1 .. y1,
+ * which must hold the luma of the image before sharpening; neighbours
+ * past the image edges are replicated.
+ */
+void
+gp_bayer_sharpen_rows (unsigned char *rgb, const unsigned char *luma, int w, int h,
+		       int y0, int y1, float amount)
+{
+	const unsigned char *a, *b, *c;
+	unsigned char *p;
+	int x, y, sum, detail;
+	int k = (int) (amount * 256.0f + 0.5f);
+	int *column;
+
+	if (y1 > h)
+		y1 = h;
+
+	/* vertical 3-sums of the luma, padded by one replicated column each side */
+	column = new int[w + 2];
+	for (y = y0; y < y1; y++) {
+		a = luma + ((y > 0) ? y - 1 : y) * w;
+		b = luma + y * w;
+		c = luma + ((y < h - 1) ? y + 1 : y) * w;
+		for (x = 0; x < w; x++)
+			column[x + 1] = a[x] + b[x] + c[x];
+		column[0] = column[1];
+		column[w + 1] = column[w];
+
+		p = rgb + y * w * 3;
+		for (x = 0; x < w; x++, p += 3) {
+			sum = column[x] + column[x + 1] + column[x + 2];
+			/* amount * (luma - mean), amount in 1/256 and mean in 1/9 */
+			detail = k * (9 * b[x] - sum) / (9 * 256);
+			p[0] = bayer_clamp (p[0] + detail);
+			p[1] = bayer_clamp (p[1] + detail);
+			p[2] = bayer_clamp (p[2] + detail);
+		}
+	}
+	delete [] column;
+}
@@ -0,0 +1,19 @@
+/**
+ * @file   bayer_sharpen.h
+ * @brief  Unsharp masking of demosaiced images on luma.
+ *
+ * The luma of each pixel is compared with the 3x3 mean of the luma
+ * around it, and amount times the difference is added to all three
+ * channels.  Working on luma sharpens detail without amplifying colour
+ * noise left by interpolation.
+ */
+
+#ifndef __BAYER_SHARPEN_H__
+#define __BAYER_SHARPEN_H__
+
+void gp_bayer_luma_rows (const unsigned char *rgb, int w, int y0, int y1,
+			 unsigned char *luma);
+void gp_bayer_sharpen_rows (unsigned char *rgb, const unsigned char *luma, int w, int h,
+			    int y0, int y1, float amount);
+
+#endif /* __BAYER_SHARPEN_H__ */
@@ -0,0 +1,148 @@
+/**
+ * @file   bayer_stats.cpp
+ * @brief  Per-frame statistics gathered from Bayer pattern images.
+ */
+
+#include <cstring>
+#include "bayer_stats.h"
+#include "bayer_pipeline.h"
+#include "bayer_strip.h"
+
+void
+gp_bayer_stats_init (BayerStats *stats, int step, int saturation)
+{
+	stats->step = (step < 1) ? 1 : step;
+	stats->saturation = saturation;
+	gp_bayer_stats_clear (stats);
+}
+
+void
+gp_bayer_stats_clear (BayerStats *stats)
+{
+	memset (stats->count, 0, sizeof (stats->count));
+	memset (stats->saturated, 0, sizeof (stats->saturated));
+	memset (stats->sum, 0, sizeof (stats->sum));
+	memset (stats->histogram, 0, sizeof (stats->histogram));
+}
+
+void
+gp_bayer_stats_merge (BayerStats *stats, const BayerStats *partial)
+{
+	int c, i;
+
+	for (c = 0; c < 3; c++) {
+		stats->count[c]     += partial->count[c];
+		stats->saturated[c] += partial->saturated[c];
+		stats->sum[c]       += partial->sum[c];
+		for (i = 0; i < BAYER_STATS_BINS; i++)
+			stats->histogram[c][i] += partial->histogram[c][i];
+	}
+}
+
+double
+gp_bayer_stats_mean (const BayerStats *stats, int colour)
+{
+	if (stats->count[colour] == 0)
+		return (0.0);
+	return (stats->sum[colour] / stats->count[colour]);
+}
+
+/*
+ * Accumulates the quads whose top row lies in [y0, y1).  y0 must be
+ * even so the quad layout matches the tile; incomplete quads at odd
+ * right and bottom edges are skipped.  The loop only fills histograms,
+ * one per quad position; counts, sums and clipping follow from them.
+ */
+int
+gp_bayer_stats_rows (const unsigned char *input, int w, int h, int y0, int y1,
+		     BayerTile tile, BayerStats *stats)
+{
+	int x, y, i, v, n;
+	int colour[4];
+	int qy;
+	int step = stats->step;
+	const unsigned char *row;
+	unsigned int local[4][BAYER_STATS_BINS];
+
+	if (tile > BAYER_TILE_GBRG || (y0 & 1))
+		return (-1);
+
+	/* colours of the four samples of a quad, in scanline order */
+	colour[0] = gp_bayer_colour (tile, 0, 0);
+	colour[1] = gp_bayer_colour (tile, 1, 0);
+	colour[2] = gp_bayer_colour (tile, 0, 1);
+	colour[3] = gp_bayer_colour (tile, 1, 1);
+
+	memset (local, 0, sizeof (local));
+	if (y1 > h - 1)
+		y1 = h - 1;
+	for (y = y0; y < y1; y += 2) {
+		qy = y >> 1;
+		if (qy % step)
+			continue;
+		row = input + y * w;
+		for (x = 0; x < w - 1; x += 2 * step) {
+			local[0][row[x]]++;
+			local[1][row[x + 1]]++;
+			local[2][row[w + x]]++;
+			local[3][row[w + x + 1]]++;
+		}
+	}
+
+	for (i = 0; i < 4; i++) {
+		for (v = 0; v < BAYER_STATS_BINS; v++) {
+			if ((n = local[i][v]) == 0)
+				continue;
+			stats->count[colour[i]] += n;
+			stats->sum[colour[i]] += (double) n * v;
+			stats->histogram[colour[i]][v] += n;
+			if (v >= stats->saturation)
+				stats->saturated[colour[i]] += n;
+		}
+	}
+
+	return (0);
+}
+
+int
+gp_bayer_stats (const unsigned char *input, int w, int h, BayerTile tile,
+		BayerStats *stats)
+{
+	int s, i;
+	int strips = bayer_strip_count (h);
+	int threads = bayer_strip_threads ();
+	BayerStats *partial;
+
+	if (tile > BAYER_TILE_GBRG)
+		return (-1);
+
+	/* one partial per thread, merged once all strips are done */
+	partial = new BayerStats[threads];
+	for (i = 0; i < threads; i++)
+		gp_bayer_stats_init (&partial[i], stats->step, stats->saturation);
+
+#pragma omp parallel for schedule(dynamic)
+	for (s = 0; s < strips; s++)
+		gp_bayer_stats_rows (input, w, h, s * BAYER_STRIP_ROWS,
+				     (s + 1) * BAYER_STRIP_ROWS, tile,
+				     &partial[bayer_strip_thread ()]);
+
+	gp_bayer_stats_clear (stats);
+	for (i = 0; i < threads; i++)
+		gp_bayer_stats_merge (stats, &partial[i]);
+	delete [] partial;
+
+	return (0);
+}
+
+/* Same as gp_bayer_decode, but also fills stats; see gp_bayer_decode_pipeline. */
+int
+gp_bayer_decode_stats (const unsigned char *input, int w, int h, unsigned char *output,
+		       BayerTile tile, BayerStats *stats)
+{
+	BayerPipeline pipeline;
+
+	gp_bayer_pipeline_init (&pipeline);
+	pipeline.stats = stats;
+	return (gp_bayer_decode_pipeline (input, w, h, output, tile, &pipeline));
+}
@@ -0,0 +1,44 @@
+/**
+ * @file   bayer_stats.h
+ * @brief  Per-frame statistics gathered from Bayer pattern images.
+ *
+ * Histograms, channel sums and clipping counts for auto-exposure and
+ * auto-white-balance, computed on (optionally decimated) 2x2 CFA
+ * quads rather than on the demosaiced image.
+ */
+
+#ifndef __BAYER_STATS_H__
+#define __BAYER_STATS_H__
+
+#include "bayer.h"
+
+/* Histogram bins per channel, one per 8-bit sample value. */
+#define BAYER_STATS_BINS 256
+
+/* Default decimation: every other quad in x and y, a sixteenth of the
+ * samples, enough for exposure and white balance. */
+#define BAYER_STATS_STEP 2
+
+typedef struct {
+	int step;		/* sample every step-th quad in x and y */
+	int saturation;		/* samples >= saturation count as clipped */
+
+	unsigned long count[3];	/* samples per channel (red, green, blue) */
+	unsigned long saturated[3];
+	double sum[3];
+	unsigned long histogram[3][BAYER_STATS_BINS];
+} BayerStats;
+
+void gp_bayer_stats_init (BayerStats *stats, int step, int saturation);
+void gp_bayer_stats_clear (BayerStats *stats);
+void gp_bayer_stats_merge (BayerStats *stats, const BayerStats *partial);
+double gp_bayer_stats_mean (const BayerStats *stats, int colour);
+
+int gp_bayer_stats_rows (const unsigned char *input, int w, int h, int y0, int y1,
+			 BayerTile tile, BayerStats *stats);
+int gp_bayer_stats (const unsigned char *input, int w, int h, BayerTile tile,
+		    BayerStats *stats);
+int gp_bayer_decode_stats (const unsigned char *input, int w, int h, unsigned char *output,
+			   BayerTile tile, BayerStats *stats);
+
+#endif /* __BAYER_STATS_H__ */
@@ -0,0 +1,214 @@
+/**
+ * @file   bayer_stream.cpp
+ * @brief  Incremental demosaicing of consecutive frames from one camera.
+ */
+
+#include <cstddef>
+#include <cstring>
+#include "bayer_stream.h"
+#ifdef __SSE2__
+# include <emmintrin.h>
+#endif
+
+BayerStream *
+gp_bayer_stream_new (int w, int h, BayerTile tile)
+{
+	BayerStream *stream = new BayerStream;
+	int n;
+
+	stream->w = w;
+	stream->h = h;
+	stream->tile = tile;
+	stream->tiles_x = (w + BAYER_STREAM_TILE_W - 1) / BAYER_STREAM_TILE_W;
+	stream->tiles_y = (h + BAYER_STREAM_TILE_H - 1) / BAYER_STREAM_TILE_H;
+	stream->threshold = 0;
+	stream->adaptive_threshold = BAYER_ADAPTIVE_THRESHOLD;
+	n = stream->tiles_x * stream->tiles_y;
+	stream->previous = new unsigned char[w * h];
+	stream->output = new unsigned char[w * h * 3]();
+	stream->changed = new unsigned char[n];
+	stream->dirty = new unsigned char[n];
+	stream->scratch = NULL;
+	stream->threads = 0;
+	gp_bayer_stream_reset (stream);
+
+	return (stream);
+}
+
+void
+gp_bayer_stream_free (BayerStream *stream)
+{
+	int i;
+
+	if (stream == NULL)
+		return;
+	for (i = 0; i < stream->threads; i++)
+		gp_bayer_ahd_scratch_free (stream->scratch[i]);
+	delete [] stream->scratch;
+	delete [] stream->previous;
+	delete [] stream->output;
+	delete [] stream->changed;
+	delete [] stream->dirty;
+	delete stream;
+}
+
+/* Makes the next frame decode in full, as the first one does. */
+void
+gp_bayer_stream_reset (BayerStream *stream)
+{
+	int n = stream->tiles_x * stream->tiles_y;
+
+	memset (stream->changed, 1, n);
+	memset (stream->dirty, 1, n);
+	stream->dirty_count = n;
+	stream->method = -1;
+	stream->adaptive_last = stream->adaptive_threshold;
+}
+
+/*
+ * Whether any sample of [x0, x1) x [y0, y1) differs between a and b by
+ * more than threshold.  Sixteen samples at a time with SSE2: the
+ * absolute difference is the OR of both saturated differences, and
+ * what remains after saturating away the threshold is accumulated over
+ * the row, so each row costs a single test.
+ */
+static int
+tile_changed (const unsigned char *a, const unsigned char *b, int w,
+	      int x0, int y0, int x1, int y1, int threshold)
+{
+	int x, y, d;
+	const unsigned char *p, *q;
+
+	for (y = y0; y < y1; y++) {
+		p = a + y * w;
+		q = b + y * w;
+		x = x0;
+#ifdef __SSE2__
+		const __m128i zero = _mm_setzero_si128 ();
+		const __m128i t = _mm_set1_epi8 ((char) threshold);
+		__m128i acc = zero;
+		for (; x + 16 <= x1; x += 16) {
+			__m128i u = _mm_loadu_si128 ((const __m128i *) (p + x));
+			__m128i v = _mm_loadu_si128 ((const __m128i *) (q + x));
+			__m128i diff = _mm_or_si128 (_mm_subs_epu8 (u, v), _mm_subs_epu8 (v, u));
+			acc = _mm_or_si128 (acc, _mm_subs_epu8 (diff, t));
+		}
+		if (_mm_movemask_epi8 (_mm_cmpeq_epi8 (acc, zero)) != 0xffff)
+			return (1);
+#endif
+		for (; x < x1; x++) {
+			d = p[x] - q[x];
+			if (d > threshold || -d > threshold)
+				return (1);
+		}
+	}
+
+	return (0);
+}
+
+/* Stores the samples of [x0, x1) x [y0, y1) as previous and native output. */
+static void
+refresh (BayerStream *stream, const unsigned char *input,
+	 int x0, int y0, int x1, int y1)
+{
+	int x, y, colour[2];
+	int w = stream->w;
+	unsigned char *q;
+
+	for (y = y0; y < y1; y++) {
+		memcpy (stream->previous + y * w + x0, input + y * w + x0, x1 - x0);
+		colour[0] = gp_bayer_colour (stream->tile, 0, y);
+		colour[1] = gp_bayer_colour (stream->tile, 1, y);
+		q = stream->output + y * w * 3;
+		for (x = x0; x < x1; x++)
+			q[x * 3 + colour[x & 1]] = input[y * w + x];
+	}
+}
+
+/*
+ * Decodes the next frame into stream->output, interpolating again only
+ * tiles whose CFA changed by more than stream->threshold since the last
+ * frame, and their neighbours.  Changing the method, or the adaptive
+ * threshold, decodes the whole frame.  stream->dirty marks the tiles
+ * of the output that were rewritten.  Returns -1 for an unsupported
+ * method or tile, leaving the stream as it was.
+ */
+int
+gp_bayer_stream_decode (BayerStream *stream, const unsigned char *input,
+			BayerMethod method)
+{
+	int t, i, full, count;
+	int w = stream->w, h = stream->h;
+	int tiles_x = stream->tiles_x, tiles_y = stream->tiles_y;
+	int n = tiles_x * tiles_y;
+
+	if (stream->tile > BAYER_TILE_GBRG || method == BAYER_METHOD_EDGE)
+		return (-1);
+	if (method == BAYER_METHOD_AHD) {
+		if (w <= BAYER_AHD_HALO || h <= BAYER_AHD_HALO)
+			return (-1);
+		if (stream->threads < bayer_strip_threads ()) {
+			for (i = 0; i < stream->threads; i++)
+				gp_bayer_ahd_scratch_free (stream->scratch[i]);
+			delete [] stream->scratch;
+			stream->threads = bayer_strip_threads ();
+			stream->scratch = new BayerAHDScratch *[stream->threads];
+			for (i = 0; i < stream->threads; i++)
+				stream->scratch[i] = gp_bayer_ahd_scratch_new ();
+		}
+	}
+	full = (stream->method != (int) method ||
+		stream->adaptive_last != stream->adaptive_threshold);
+
+	/* compare the tiles, refreshing the native samples of changed ones */
+#pragma omp parallel for schedule(dynamic)
+	for (t = 0; t < n; t++) {
+		int x0 = (t % tiles_x) * BAYER_STREAM_TILE_W;
+		int y0 = (t / tiles_x) * BAYER_STREAM_TILE_H;
+		int x1 = (x0 + BAYER_STREAM_TILE_W > w) ? w : x0 + BAYER_STREAM_TILE_W;
+		int y1 = (y0 + BAYER_STREAM_TILE_H > h) ? h : y0 + BAYER_STREAM_TILE_H;
+
+		stream->changed[t] = full || tile_changed (input, stream->previous, w,
+							   x0, y0, x1, y1, stream->threshold);
+		if (stream->changed[t])
+			refresh (stream, input, x0, y0, x1, y1);
+	}
+
+	/* no kernel reaches further than one tile, so its neighbours follow */
+	count = 0;
+	for (t = 0; t < n; t++) {
+		int tx = t % tiles_x, ty = t / tiles_x, dx, dy, d = 0;
+
+		for (dy = -1; dy <= 1 && !d; dy++)
+			for (dx = -1; dx <= 1 && !d; dx++)
+				if (tx + dx >= 0 && tx + dx < tiles_x &&
+				    ty + dy >= 0 && ty + dy < tiles_y)
+					d = stream->changed[(ty + dy) * tiles_x + tx + dx];
+		stream->dirty[t] = d;
+		count += d;
+	}
+
+	/* interpolate the dirty tiles from the now current native samples */
+#pragma omp parallel for schedule(dynamic)
+	for (t = 0; t < n; t++) {
+		int x0 = (t % tiles_x) * BAYER_STREAM_TILE_W;
+		int y0 = (t / tiles_x) * BAYER_STREAM_TILE_H;
+
+		if (!stream->dirty[t])
+			continue;
+		if (method == BAYER_METHOD_AHD)
+			gp_bayer_ahd_rect (stream->output, w, h, x0, y0,
+					   x0 + BAYER_STREAM_TILE_W, y0 + BAYER_STREAM_TILE_H,
+					   stream->tile, stream->scratch[bayer_strip_thread ()]);
+		else
+			gp_bayer_method_rect (stream->output, w, h, x0, y0,
+					      x0 + BAYER_STREAM_TILE_W, y0 + BAYER_STREAM_TILE_H,
+					      stream->tile, method, stream->adaptive_threshold);
+	}
+
+	stream->dirty_count = count;
+	stream->method = method;
+	stream->adaptive_last = stream->adaptive_threshold;
+
+	return (0);
+}
@@ -0,0 +1,52 @@
+/**
+ * @file   bayer_stream.h
+ * @brief  Incremental demosaicing of consecutive frames from one camera.
+ *
+ * A stream keeps the last CFA frame it decoded and the RGB image it
+ * produced.  Each new frame is compared with the last one in tiles of
+ * #BAYER_STREAM_TILE_W by #BAYER_STREAM_TILE_H pixels, and only tiles
+ * that changed, and their neighbours whose kernels reach into them, are
+ * interpolated again.  On a mostly static scene most of the frame is
+ * neither demosaiced nor, by a caller that uploads only the dirty
+ * tiles, copied anywhere.
+ *
+ * Tiles are aligned with the strips and adaptive blocks of
+ * gp_bayer_decode_pipeline, so the output matches what it produces with
+ * no stages enabled.  Only the methods that interpolate rectangles
+ * independently are supported: not BAYER_METHOD_EDGE.
+ */
+
+#ifndef __BAYER_STREAM_H__
+#define __BAYER_STREAM_H__
+
+#include "bayer_pipeline.h"
+#include "bayer_strip.h"
+
+/* Width and height of the tiles compared between frames. */
+#define BAYER_STREAM_TILE_W BAYER_ADAPTIVE_BLOCK
+#define BAYER_STREAM_TILE_H BAYER_STRIP_ROWS
+
+typedef struct {
+	int w, h;
+	BayerTile tile;
+	int tiles_x, tiles_y;		/* tiles across and down */
+	int threshold;			/* largest sample difference ignored */
+	int adaptive_threshold;		/* gradient energy for BAYER_METHOD_ADAPTIVE */
+	unsigned char *previous;	/* CFA the output was decoded from */
+	unsigned char *output;		/* RGB image, w * h * 3 */
+	unsigned char *changed;		/* per tile, CFA differs from previous */
+	unsigned char *dirty;		/* per tile, output rewritten by the last frame */
+	int dirty_count;		/* tiles rewritten by the last frame */
+	int method;			/* method of the last frame, or -1 before the first */
+	int adaptive_last;		/* adaptive_threshold of the last frame */
+	BayerAHDScratch **scratch;	/* per thread, allocated for BAYER_METHOD_AHD */
+	int threads;
+} BayerStream;
+
+BayerStream *gp_bayer_stream_new (int w, int h, BayerTile tile);
+void gp_bayer_stream_free (BayerStream *stream);
+void gp_bayer_stream_reset (BayerStream *stream);
+int gp_bayer_stream_decode (BayerStream *stream, const unsigned char *input,
+			    BayerMethod method);
+
+#endif /* __BAYER_STREAM_H__ */
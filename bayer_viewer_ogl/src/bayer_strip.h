@@ -0,0 +1,49 @@
+/**
+ * @file   bayer_strip.h
+ * @brief  Helpers for strip-parallel processing of Bayer pattern images.
+ *
+ * Images are split into horizontal strips of #BAYER_STRIP_ROWS rows
+ * that are processed independently, one OpenMP thread per strip.
+ * Without OpenMP the strips run serially on the calling thread.
+ */
+
+#ifndef __BAYER_STRIP_H__
+#define __BAYER_STRIP_H__
+
+#ifdef _OPENMP
+# include <omp.h>
+#endif
+
+/* Rows per strip.  Even, so every strip starts on the same CFA phase. */
+#define BAYER_STRIP_ROWS 16
+
+/* Number of strips covering h rows. */
+static inline int
+bayer_strip_count (int h)
+{
+	return ((h + BAYER_STRIP_ROWS - 1) / BAYER_STRIP_ROWS);
+}
+
+/* Maximum number of threads working on strips. */
+static inline int
+bayer_strip_threads ()
+{
+#ifdef _OPENMP
+	return (omp_get_max_threads ());
+#else
+	return (1);
+#endif
+}
+
+/* Index of the calling thread, in [0, bayer_strip_threads ()). */
+static inline int
+bayer_strip_thread ()
+{
+#ifdef _OPENMP
+	return (omp_get_thread_num ());
+#else
+	return (0);
+#endif
+}
+
+#endif /* __BAYER_STRIP_H__ */
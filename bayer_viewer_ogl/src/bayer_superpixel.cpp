@@ -0,0 +1,75 @@
+/**
+ * @file   bayer_superpixel.cpp
+ * @brief  Superpixel demosaicing of Bayer pattern images.
+ */
+
+#include "bayer_superpixel.h"
+
+/*
+ * Fills in the missing colours of pixels [x0, x1) x [y0, y1) of an image
+ * expanded by gp_bayer_expand.  Reads only native samples and writes
+ * only missing ones.  An odd last row or column is paired with the one
+ * before it, which is the only sample read outside the rectangle when
+ * x0 and y0 are even.
+ */
+int
+gp_bayer_superpixel_rect (unsigned char *image, int w, int h, int x0, int y0, int x1, int y1,
+			  BayerTile tile)
+{
+	int x, y, qx, qy, px, i, c;
+	int colour[4], rgb[3];
+	const unsigned char *quad;
+	unsigned char *q;
+
+	if (tile > BAYER_TILE_GBRG || w < 2 || h < 2)
+		return (-1);
+
+	/* colours by column and row parity */
+	for (i = 0; i < 4; i++)
+		colour[i] = gp_bayer_colour (tile, i & 1, i >> 1);
+
+	if (x0 < 0)
+		x0 = 0;
+	if (x1 > w)
+		x1 = w;
+	for (y = y0; y < y1 && y < h; y++) {
+		qy = ((y | 1) < h) ? (y & ~1) : y - 1;
+		q = image + y * w * 3;
+		for (x = x0 & ~1; x < x1; x += 2) {
+			qx = (x + 1 < w) ? x : x - 1;
+			quad = image + (qy * w + qx) * 3;
+
+			/* one red, two green and one blue sample per quad */
+			rgb[0] = rgb[1] = rgb[2] = 0;
+			c = colour[(qx & 1) + 2 * (qy & 1)];
+			rgb[c] += quad[c];
+			c = colour[((qx + 1) & 1) + 2 * (qy & 1)];
+			rgb[c] += quad[3 + c];
+			c = colour[(qx & 1) + 2 * ((qy + 1) & 1)];
+			rgb[c] += quad[w * 3 + c];
+			c = colour[((qx + 1) & 1) + 2 * ((qy + 1) & 1)];
+			rgb[c] += quad[w * 3 + 3 + c];
+			rgb[1] = (rgb[1] + 1) >> 1;
+
+			for (px = (x < x0) ? x0 : x; px < x + 2 && px < x1; px++) {
+				c = colour[(px & 1) + 2 * (y & 1)];
+				if (c != 0)
+					q[px * 3 + 0] = rgb[0];
+				if (c != 1)
+					q[px * 3 + 1] = rgb[1];
+				if (c != 2)
+					q[px * 3 + 2] = rgb[2];
+			}
+		}
+	}
+
+	return (0);
+}
+
+/* Fills in the missing colours of rows [y0, y1), as gp_bayer_superpixel_rect. */
+int
+gp_bayer_superpixel_rows (unsigned char *image, int w, int h, int y0, int y1,
+			  BayerTile tile)
+{
+	return (gp_bayer_superpixel_rect (image, w, h, 0, y0, w, y1, tile));
+}
@@ -0,0 +1,21 @@
+/**
+ * @file   bayer_superpixel.h
+ * @brief  Superpixel demosaicing of Bayer pattern images.
+ *
+ * Every pixel takes the colour of the 2x2 quad it lies in: the quad's
+ * red and blue samples and the mean of its two greens.  Halves the
+ * effective resolution, but costs a fraction of bilinear and has no
+ * reach beyond the quad.
+ */
+
+#ifndef __BAYER_SUPERPIXEL_H__
+#define __BAYER_SUPERPIXEL_H__
+
+#include "bayer.h"
+
+int gp_bayer_superpixel_rect (unsigned char *image, int w, int h, int x0, int y0, int x1, int y1,
+			      BayerTile tile);
+int gp_bayer_superpixel_rows (unsigned char *image, int w, int h, int y0, int y1,
+			      BayerTile tile);
+
+#endif /* __BAYER_SUPERPIXEL_H__ */
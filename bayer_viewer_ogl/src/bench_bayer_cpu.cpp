@@ -0,0 +1,518 @@
+/**
+ * @file   bench_bayer_cpu.cpp
+ * @brief  Throughput and quality benchmark for the CPU demosaicing engines.
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <cmath>
+#include <ctime>
+#include <iostream>
+#include <unistd.h>
+#include <magick/api.h>
+#include "bayer_focus.h"
+#include "bayer_pipeline.h"
+#include "bayer_stream.h"
+#ifdef _OPENMP
+# include <omp.h>
+#endif
+
+// types for loading images
+enum
+{
+	GRAYSCALE,
+	RGB
+};
+
+/// Bayer tile of the example images once flipped (see read_image).
+static const BayerTile TILE = BAYER_TILE_GRBG;
+
+/// Pixels at each image border left out of PSNR.
+static const int BORDER = 4;
+
+/// Range threshold used for the denoising engine.
+static const int DENOISE_THRESHOLD = 24;
+
+/// Unsharp-mask amount used for the sharpening engine.
+static const float SHARPEN_AMOUNT = 0.5;
+
+/// Clipping level counted by the statistics engine.
+static const int STATS_SATURATION = 250;
+
+/// Largest overhead of the statistics stage over the plain pipeline.
+static const double STATS_BUDGET = 0.05;
+
+/// Defects in the map of the defect engine, each on a row of its own.
+static const int DEFECTS = 64;
+
+/// Batches the iterations of each engine are timed in; the fastest
+/// batch is reported, being the least disturbed by the rest of the
+/// system.
+static const int BATCHES = 5;
+
+/// Columns and rows of focus regions.
+static const int FOCUS_GRID = 4;
+
+/// Demosaics a w x h Bayer image into RGB.
+typedef int (*Decoder) (const unsigned char *bayer, int w, int h, unsigned char *rgb);
+
+/// Demosaicing engine under test.
+struct Engine
+{
+	const char *name;
+	Decoder decode;
+	bool rgb;		///< Writes an image, so has a PSNR.
+};
+
+/// Focus metrics of the last focus engine run, so they are not optimized away.
+static double focus_metrics[FOCUS_GRID * FOCUS_GRID];
+
+/// reads image file into array
+static unsigned char *
+read_image (const char *filename,
+	    int         type,
+	    int        *width,
+	    int        *height)
+{
+	ExceptionInfo exception;
+	Image *image;
+	Image *flip_image;
+	ImageInfo *image_info;
+	const PixelPacket *pixels;
+	unsigned char *data = NULL;
+	unsigned int i;
+	unsigned int j;
+	int w, h;
+
+	// initialize the image info structure and read image
+	GetExceptionInfo (&exception);
+	image_info = CloneImageInfo ((ImageInfo *) NULL);
+	strncpy (image_info->filename, filename, MaxTextExtent);
+	image_info->filename[MaxTextExtent-1] = '\0';
+	image = ReadImage (image_info, &exception);
+	if (image == NULL) {
+		MagickError(exception.severity, exception.reason, exception.description);
+		return (NULL);
+	}
+	*width = w = image->columns;
+	*height = h = image->rows;
+
+	// flip image, as the viewers do
+	flip_image = FlipImage (image, &exception);
+	DestroyImage (image);
+	if (!flip_image) {
+		MagickError (exception.severity, exception.reason, exception.description);
+		return (NULL);
+	}
+	image = flip_image;
+
+	// copy pixels to array
+	pixels = AcquireImagePixels (image, 0, 0, image->columns, image->rows, &exception);
+	if (!pixels) {
+		MagickError(exception.severity, exception.reason, exception.description);
+		return (NULL);
+	}
+	if (type == GRAYSCALE) {
+		data = new unsigned char[w * h];
+		for (j = 0; j < image->rows; j++) {
+			for (i = 0; i < image->columns; i++) {
+				data[j*w+i] = pixels[i + image->columns*j].red;
+			}
+		}
+	} else {
+		data = new unsigned char[w * h * 3];
+		for (j = 0; j < image->rows; j++) {
+			for (i = 0; i < image->columns; i++) {
+				int idx = (j * w + i) * 3;
+				data[idx+0] = pixels[i + image->columns*j].red;
+				data[idx+1] = pixels[i + image->columns*j].green;
+				data[idx+2] = pixels[i + image->columns*j].blue;
+			}
+		}
+	}
+	DestroyImageInfo (image_info);
+	DestroyExceptionInfo (&exception);
+	DestroyImage (image);
+	return data;
+}
+
+/// wall-clock time in seconds
+static double
+now ()
+{
+#ifdef _OPENMP
+	return omp_get_wtime ();
+#else
+	return static_cast<double>(clock ()) / CLOCKS_PER_SEC;
+#endif
+}
+
+/// adds zero-mean noise with roughly the given standard deviation
+static void
+add_noise (unsigned char *bayer,
+	   int n,
+	   double sigma)
+{
+	for (int i = 0; i < n; i++) {
+		// sum of three uniforms, scaled to unit variance
+		double u = (static_cast<double>(rand ()) + rand () + rand ()) / RAND_MAX - 1.5;
+		int v = static_cast<int>(bayer[i] + 2.0 * sigma * u + 0.5);
+		bayer[i] = (v < 0) ? 0 : (v > 255) ? 255 : v;
+	}
+}
+
+/// PSNR of rgb against reference, in dB, ignoring a #BORDER pixel frame
+static double
+psnr (const unsigned char *rgb,
+      const unsigned char *reference,
+      int w,
+      int h)
+{
+	double sse = 0.0;
+	long n = 0;
+
+	for (int y = BORDER; y < h - BORDER; y++) {
+		for (int x = 3 * BORDER; x < 3 * (w - BORDER); x++) {
+			double d = rgb[y*w*3+x] - reference[y*w*3+x];
+			sse += d * d;
+			n++;
+		}
+	}
+	if (sse == 0.0) {
+		return 99.99;
+	}
+	return 10.0 * log10 (255.0 * 255.0 * n / sse);
+}
+
+static int
+decode_bilinear (const unsigned char *bayer, int w, int h, unsigned char *rgb)
+{
+	return gp_bayer_decode (bayer, w, h, rgb, TILE);
+}
+
+static int
+decode_pipeline (const unsigned char *bayer, int w, int h, unsigned char *rgb)
+{
+	BayerPipeline pipeline;
+
+	gp_bayer_pipeline_init (&pipeline);
+	return gp_bayer_decode_pipeline (bayer, w, h, rgb, TILE, &pipeline);
+}
+
+static int
+decode_denoise (const unsigned char *bayer, int w, int h, unsigned char *rgb)
+{
+	BayerPipeline pipeline;
+
+	gp_bayer_pipeline_init (&pipeline);
+	pipeline.denoise = DENOISE_THRESHOLD;
+	return gp_bayer_decode_pipeline (bayer, w, h, rgb, TILE, &pipeline);
+}
+
+static int
+decode_sharpen (const unsigned char *bayer, int w, int h, unsigned char *rgb)
+{
+	BayerPipeline pipeline;
+
+	gp_bayer_pipeline_init (&pipeline);
+	pipeline.sharpen = SHARPEN_AMOUNT;
+	return gp_bayer_decode_pipeline (bayer, w, h, rgb, TILE, &pipeline);
+}
+
+static int
+decode_stats (const unsigned char *bayer, int w, int h, unsigned char *rgb)
+{
+	BayerPipeline pipeline;
+	BayerStats stats;
+
+	gp_bayer_stats_init (&stats, BAYER_STATS_STEP, STATS_SATURATION);
+	gp_bayer_pipeline_init (&pipeline);
+	pipeline.stats = &stats;
+	return gp_bayer_decode_pipeline (bayer, w, h, rgb, TILE, &pipeline);
+}
+
+// A sparse defect map: most rows have no defects, and should cost
+// nothing over the plain pipeline.
+static int
+decode_defects (const unsigned char *bayer, int w, int h, unsigned char *rgb)
+{
+	BayerPipeline pipeline;
+	static BayerDefects *defects = NULL;
+
+	if (defects == NULL) {
+		int coords[2 * DEFECTS];
+		for (int i = 0; i < DEFECTS; i++) {
+			coords[2 * i] = (i * 7919) % w;
+			coords[2 * i + 1] = (i * h) / DEFECTS;
+		}
+		defects = gp_bayer_defects_new (coords, DEFECTS, w, h);
+	}
+	gp_bayer_pipeline_init (&pipeline);
+	pipeline.defects = defects;
+	return gp_bayer_decode_pipeline (bayer, w, h, rgb, TILE, &pipeline);
+}
+
+static int
+decode_gradient (const unsigned char *bayer, int w, int h, unsigned char *rgb)
+{
+	BayerPipeline pipeline;
+
+	gp_bayer_pipeline_init (&pipeline);
+	pipeline.method = BAYER_METHOD_GRADIENT;
+	return gp_bayer_decode_pipeline (bayer, w, h, rgb, TILE, &pipeline);
+}
+
+static int
+decode_adaptive (const unsigned char *bayer, int w, int h, unsigned char *rgb)
+{
+	BayerPipeline pipeline;
+
+	gp_bayer_pipeline_init (&pipeline);
+	pipeline.method = BAYER_METHOD_ADAPTIVE;
+	return gp_bayer_decode_pipeline (bayer, w, h, rgb, TILE, &pipeline);
+}
+
+static int
+decode_superpixel (const unsigned char *bayer, int w, int h, unsigned char *rgb)
+{
+	BayerPipeline pipeline;
+
+	gp_bayer_pipeline_init (&pipeline);
+	pipeline.method = BAYER_METHOD_SUPERPIXEL;
+	return gp_bayer_decode_pipeline (bayer, w, h, rgb, TILE, &pipeline);
+}
+
+static int
+decode_edge (const unsigned char *bayer, int w, int h, unsigned char *rgb)
+{
+	BayerPipeline pipeline;
+
+	gp_bayer_pipeline_init (&pipeline);
+	pipeline.method = BAYER_METHOD_EDGE;
+	return gp_bayer_decode_pipeline (bayer, w, h, rgb, TILE, &pipeline);
+}
+
+static int
+decode_ahd (const unsigned char *bayer, int w, int h, unsigned char *rgb)
+{
+	BayerPipeline pipeline;
+
+	gp_bayer_pipeline_init (&pipeline);
+	pipeline.method = BAYER_METHOD_AHD;
+	return gp_bayer_decode_pipeline (bayer, w, h, rgb, TILE, &pipeline);
+}
+
+static int
+decode_pyramid (const unsigned char *bayer, int w, int h, unsigned char *rgb)
+{
+	BayerPipeline pipeline;
+	static BayerPyramid *pyramid = NULL;
+
+	if (pyramid == NULL) {
+		pyramid = gp_bayer_pyramid_new (w, h, BAYER_PYRAMID_LEVELS);
+	}
+	gp_bayer_pipeline_init (&pipeline);
+	pipeline.pyramid = pyramid;
+	return gp_bayer_decode_pipeline (bayer, w, h, rgb, TILE, &pipeline);
+}
+
+// Focus metrics on the CFA greens, as an autofocus sweep takes them.
+static int
+decode_focus (const unsigned char *bayer, int w, int h, unsigned char *rgb)
+{
+	return gp_bayer_focus_grid (bayer, w, h, TILE, FOCUS_GRID, FOCUS_GRID, focus_metrics);
+}
+
+// The same regions measured the usual way: demosaic, then the variance
+// of the Laplacian of green in each region.
+static int
+decode_laplacian (const unsigned char *bayer, int w, int h, unsigned char *rgb)
+{
+	if (decode_pipeline (bayer, w, h, rgb) != 0) {
+		return -1;
+	}
+#pragma omp parallel for schedule(dynamic)
+	for (int i = 0; i < FOCUS_GRID * FOCUS_GRID; i++) {
+		int c = i % FOCUS_GRID, r = i / FOCUS_GRID;
+		int x0 = c * w / FOCUS_GRID, x1 = (c + 1) * w / FOCUS_GRID;
+		int y0 = r * h / FOCUS_GRID, y1 = (r + 1) * h / FOCUS_GRID;
+		double sum = 0.0, sum2 = 0.0;
+		long n = 0;
+
+		x0 = (x0 < 1) ? 1 : x0;
+		x1 = (x1 > w - 1) ? w - 1 : x1;
+		y0 = (y0 < 1) ? 1 : y0;
+		y1 = (y1 > h - 1) ? h - 1 : y1;
+		for (int y = y0; y < y1; y++) {
+			const unsigned char *g = rgb + y * w * 3 + 1;
+			for (int x = x0; x < x1; x++) {
+				int l = 4 * g[x*3] - g[x*3-3] - g[x*3+3] - g[(x-w)*3] - g[(x+w)*3];
+				sum += l;
+				sum2 += l * l;
+				n++;
+			}
+		}
+		focus_metrics[i] = (n > 0) ? sum2 / n - (sum / n) * (sum / n) : 0.0;
+	}
+	return 0;
+}
+
+// Repeats of the same frame are the static-scene case: after the first
+// one nothing is demosaiced, and only the copy out remains.
+static int
+decode_stream (const unsigned char *bayer, int w, int h, unsigned char *rgb)
+{
+	static BayerStream *stream = NULL;
+
+	if (stream == NULL) {
+		stream = gp_bayer_stream_new (w, h, TILE);
+	}
+	if (gp_bayer_stream_decode (stream, bayer, BAYER_METHOD_GRADIENT) != 0) {
+		return -1;
+	}
+	memcpy (rgb, stream->output, w * h * 3);
+	return 0;
+}
+
+static const Engine ENGINES[] =
+{
+	{"bilinear", decode_bilinear, true},
+	{"pipeline", decode_pipeline, true},
+	{"pipeline + denoise", decode_denoise, true},
+	{"pipeline + sharpen", decode_sharpen, true},
+	{"pipeline + stats", decode_stats, true},
+	{"pipeline + defects", decode_defects, true},
+	{"pipeline + pyramid", decode_pyramid, true},
+	{"gradient", decode_gradient, true},
+	{"adaptive", decode_adaptive, true},
+	{"superpixel", decode_superpixel, true},
+	{"edge-directed", decode_edge, true},
+	{"AHD", decode_ahd, true},
+	{"stream (static)", decode_stream, true},
+	{"focus grid", decode_focus, false},
+	{"pipeline + Laplacian", decode_laplacian, false},
+};
+
+/// main function
+int
+main (int   argc,
+      char *argv[])
+{
+	const char *reference_filename = NULL;
+	unsigned char *bayer, *reference = NULL, *rgb;
+	int iterations = 100;
+	double noise = 0.0;
+	double base_time = 0.0;
+	double pipeline_time = 0.0, stats_time = 0.0, defects_time = 0.0;
+	double focus_time = 0.0, laplacian_time = 0.0;
+	int w, h, rw, rh, c;
+	bool errflag = false;
+
+	while ((c = getopt (argc, argv, "n:r:s:")) != -1) {
+		switch (c) {
+		case 'n':
+			iterations = strtol (optarg, NULL, 10);
+			break;
+		case 'r':
+			reference_filename = optarg;
+			break;
+		case 's':
+			noise = strtod (optarg, NULL);
+			break;
+		default:
+			errflag = true;
+			break;
+		}
+	}
+	if (errflag || (argc - optind) != 1 || iterations < 1) {
+		std::cerr << "Usage: " << argv[0] << " [-n iterations] [-r reference] [-s noise] <bayer image filename>" << std::endl;
+		std::cerr << "Times the CPU demosaicing engines and, given a reference RGB" << std::endl;
+		std::cerr << "image, reports their PSNR.  -s adds noise of that standard" << std::endl;
+		std::cerr << "deviation to the Bayer image first." << std::endl;
+		return (EXIT_FAILURE);
+	}
+
+	InitializeMagick (*argv);
+	if ((bayer = read_image (argv[optind], GRAYSCALE, &w, &h)) == NULL) {
+		std::cerr << "ERROR: unable to read image '" << argv[optind] << "'" << std::endl;
+		return (EXIT_FAILURE);
+	}
+	if (reference_filename != NULL) {
+		if ((reference = read_image (reference_filename, RGB, &rw, &rh)) == NULL) {
+			std::cerr << "ERROR: unable to read image '" << reference_filename << "'" << std::endl;
+			return (EXIT_FAILURE);
+		}
+		if (rw != w || rh != h) {
+			std::cerr << "ERROR: reference image size differs from Bayer image" << std::endl;
+			return (EXIT_FAILURE);
+		}
+	}
+	if (noise > 0.0) {
+		add_noise (bayer, w * h, noise);
+	}
+	rgb = new unsigned char[w * h * 3];
+
+	printf ("%dx%d, %d iterations\n", w, h, iterations);
+	printf ("%-24s %10s %12s %10s %10s\n", "engine", "ms/frame", "Mpixel/s", "relative", "PSNR (dB)");
+	for (unsigned int e = 0; e < sizeof (ENGINES) / sizeof (ENGINES[0]); e++) {
+		ENGINES[e].decode (bayer, w, h, rgb);	// warm up
+		int batch = (iterations + BATCHES - 1) / BATCHES;
+		double t = 0.0;
+		for (int b = 0; b < BATCHES; b++) {
+			double start = now ();
+			for (int i = 0; i < batch; i++) {
+				ENGINES[e].decode (bayer, w, h, rgb);
+			}
+			double bt = (now () - start) / batch;
+			t = (b == 0 || bt < t) ? bt : t;
+		}
+		if (e == 0) {
+			base_time = t;
+		}
+		if (ENGINES[e].decode == decode_pipeline) {
+			pipeline_time = t;
+		} else if (ENGINES[e].decode == decode_stats) {
+			stats_time = t;
+		} else if (ENGINES[e].decode == decode_defects) {
+			defects_time = t;
+		} else if (ENGINES[e].decode == decode_focus) {
+			focus_time = t;
+		} else if (ENGINES[e].decode == decode_laplacian) {
+			laplacian_time = t;
+		}
+		printf ("%-24s %10.3f %12.1f %10.2f", ENGINES[e].name, 1e3 * t,
+			w * h / t / 1e6, t / base_time);
+		if (reference != NULL && ENGINES[e].rgb) {
+			printf (" %10.2f", psnr (rgb, reference, w, h));
+		}
+		printf ("\n");
+	}
+
+	// The statistics stage is meant to be nearly free.
+	double overhead = stats_time / pipeline_time - 1.0;
+	printf ("\nstats overhead over pipeline: %.1f%% (budget %.0f%%)%s\n", 100.0 * overhead,
+		100.0 * STATS_BUDGET, (overhead > STATS_BUDGET) ? "  OVER BUDGET" : "");
+	printf ("defects overhead over pipeline: %.1f%% (%d defects on %d of %d rows)\n",
+		100.0 * (defects_time / pipeline_time - 1.0), DEFECTS, (DEFECTS < h) ? DEFECTS : h, h);
+
+	// Rows without defects should cost one comparison each; time the
+	// correction stage alone over a frame with none.
+	BayerDefects *none = gp_bayer_defects_new (NULL, 0, w, h);
+	double start = now ();
+	for (int i = 0; i < iterations; i++) {
+		gp_bayer_defects_correct_rows (none, bayer, w, h, 0, h, rgb, TILE);
+	}
+	double t = (now () - start) / iterations;
+	gp_bayer_defects_free (none);
+	printf ("defect correction on rows without defects: %.2f ns/row (%.3f%% of pipeline)\n",
+		1e9 * t / h, 100.0 * t / pipeline_time);
+	printf ("%dx%d focus grid: %.1fx faster than demosaic + Laplacian, %.1fx faster than pipeline alone\n",
+		FOCUS_GRID, FOCUS_GRID, laplacian_time / focus_time, pipeline_time / focus_time);
+
+	delete [] rgb;
+	delete [] bayer;
+	delete [] reference;
+	DestroyMagick ();
+	return (EXIT_SUCCESS);
+}
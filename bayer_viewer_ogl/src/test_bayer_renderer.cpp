@@ -11,6 +11,12 @@
 #include <magick/api.h>
 #include "GLUTFPSCounter.hpp"
 #include "BayerRenderer.hpp"
+#include "BayerRendererGLSL.hpp"
+#include "BayerRendererCompute.hpp"
+#ifdef HEADLESS
+# include <sys/time.h>
+# include "OffscreenContext.hpp"
+#endif
 #include <GL/glut.h>
 
 // types for loading images
@@ -38,6 +44,14 @@ static GLubyte *bayer = NULL;
 static GLUTFPSCounter fps_counter;
 static BayerRenderer *br;
 
+// GLSL renderer, or NULL if not supported, and whether it is drawn
+static BayerRendererGLSL *glsl = NULL;
+static bool use_glsl = false;
+
+// compute renderer, or NULL if not supported, and whether it is drawn
+static BayerRendererCompute *compute = NULL;
+static bool use_compute = false;
+
 /// reads image file into array
 GLubyte *
 read_image (const char *filename,
@@ -151,6 +165,41 @@ write_image (const char *filename,
 	return (0);
 }
 
+/// renders the image with a rectangle changed, once updating just the
+/// rectangle and once in full, and returns the largest difference
+int
+check_partial ()
+{
+	BayerRenderer::Rect rect = {width / 3, height / 3, 17, 13};
+	GLubyte *changed = new GLubyte[width * height];
+	GLubyte *partial = new GLubyte[width * height * 3];
+	GLubyte *full = new GLubyte[width * height * 3];
+	int diff = 0;
+
+	memcpy (changed, bayer, width * height);
+	for (int y = rect.y; y < rect.y + rect.height; y++) {
+		for (int x = rect.x; x < rect.x + rect.width; x++) {
+			changed[y * width + x] = 255 - changed[y * width + x];
+		}
+	}
+	br->SetBayer (bayer);
+	br->SetBayer (changed, &rect, 1);
+	br->Bind ();
+	glGetTexImage (GL_TEXTURE_RECTANGLE_NV, 0, GL_RGB, GL_UNSIGNED_BYTE, partial);
+	br->SetBayer (changed);
+	br->Bind ();
+	glGetTexImage (GL_TEXTURE_RECTANGLE_NV, 0, GL_RGB, GL_UNSIGNED_BYTE, full);
+	for (int i = 0; i < width * height * 3; i++) {
+		int d = abs (partial[i] - full[i]);
+		diff = (d > diff) ? d : diff;
+	}
+
+	delete [] changed;
+	delete [] partial;
+	delete [] full;
+	return diff;
+}
+
 /// glut idle callback
 void
 idle ()
@@ -158,28 +207,65 @@ idle ()
 	glutPostRedisplay ();
 }
 
-/// glut display callback
+/// demosaics the bayer image and draws it
 void
-display ()
+draw ()
 {
-	bool display_fps = fps_counter.update ();
-	
 	glClear (GL_COLOR_BUFFER_BIT);
-	br->SetBayer (bayer);	// bayer is ptr to bayer image
-	br->Bind ();
-	br->EnableTextureTarget ();
+	if (use_glsl) {
+		glsl->SetBayer (bayer);
+		glsl->Bind ();
+		glsl->EnableTextureTarget ();
+	} else if (use_compute) {
+		compute->SetBayer (bayer);
+		compute->Bind ();
+		compute->EnableTextureTarget ();
+	} else {
+		br->SetBayer (bayer);	// bayer is ptr to bayer image
+		br->Bind ();
+		br->EnableTextureTarget ();
+	}
 	glBegin (GL_QUADS);
 	glTexCoord2i (0, 0);          glVertex2i (0, 0);
 	glTexCoord2i (width, 0);      glVertex2i (width, 0);
 	glTexCoord2i (width, height); glVertex2i (width, height);
 	glTexCoord2i (0, height);     glVertex2i (0, height);
 	glEnd();
-	br->DisableTextureTarget ();
+	if (use_glsl) {
+		glsl->DisableTextureTarget ();
+	} else if (use_compute) {
+		compute->DisableTextureTarget ();
+	} else {
+		br->DisableTextureTarget ();
+	}
+}
+
+/// name of the renderer drawn, for the FPS line
+const char *
+renderer_name ()
+{
+	if (use_glsl) {
+		return " (GLSL)";
+	} else if (use_compute) {
+		return compute->GetMethod () == BayerRendererCompute::METHOD_GRADIENT ?
+			" (compute, gradient)" : " (compute, bilinear)";
+	}
+	return "";
+}
+
+/// glut display callback
+void
+display ()
+{
+	bool display_fps = fps_counter.update ();
+
+	draw ();
   	glutSwapBuffers ();
+	br->PollReadback (false);
 
 	// print FPS
 	if (display_fps) {
-		printf ("FPS: %3.2f\n", fps_counter.get_fps ());
+		printf ("FPS: %3.2f%s\n", fps_counter.get_fps (), renderer_name ());
 	}
 }
 
@@ -200,11 +286,28 @@ reshape (int w,
   	glutPostRedisplay ();
 }
 
+/// readback callback: saves the demosaiced image
+void
+save_frame (const GLubyte *rgb,
+	    int frame,
+	    void *data)
+{
+	if (write_image (SCREENSHOT_FILENAME, rgb, width, height) != 0) {
+		std::cerr << "ERROR: unable to write file '" << SCREENSHOT_FILENAME << "'" << std::endl;
+	}
+}
+
 /// takes screenshot of rectangle with origin (x,y)
 void
 screenshot (int x,
             int y)
 {
+	// read the demosaiced image back without stalling; save_frame
+	// writes it a frame or two later
+	if (!use_glsl && !use_compute && br->ReadBack (0)) {
+		return;
+	}
+
 	unsigned char *p = NULL;
 	glReadBuffer (GL_FRONT);
 	p = new unsigned char[width * height * 3];
@@ -226,8 +329,11 @@ select_from_menu (int command)
 		break;
 	case MENU_QUIT:
 		if (br != NULL) {
+			br->PollReadback (true);
 			delete br;
 		}
+		delete glsl;
+		delete compute;
 		exit (EXIT_SUCCESS);
 		break;
 	}
@@ -250,6 +356,27 @@ on_key_press (unsigned char key,
 	case 's':
 		select_from_menu (MENU_SCREENSHOT);
 		break;
+	case 'G':
+	case 'g':
+		use_glsl = !use_glsl && glsl != NULL;
+		use_compute = false;
+		break;
+	case 'C':
+	case 'c':
+		// off, bilinear, gradient-corrected, off
+		if (compute == NULL) {
+			break;
+		}
+		if (!use_compute) {
+			compute->SetMethod (BayerRendererCompute::METHOD_BILINEAR);
+			use_compute = true;
+		} else if (compute->GetMethod () == BayerRendererCompute::METHOD_BILINEAR) {
+			compute->SetMethod (BayerRendererCompute::METHOD_GRADIENT);
+		} else {
+			use_compute = false;
+		}
+		use_glsl = false;
+		break;
   	};
   	glutPostRedisplay();
 }
@@ -267,6 +394,103 @@ build_glut_menu ()
 	return menu;
 }
 
+#ifdef HEADLESS
+/// draws frames frames in an offscreen context, prints the frame rate,
+/// and saves the last frame
+int
+run_headless (int frames)
+{
+	OffscreenContext offscreen;
+	if (!offscreen.Initialize (width, height)) {
+		std::cerr << "ERROR: unable to create offscreen context" << std::endl;
+		return (EXIT_FAILURE);
+	}
+	std::cout << "Using " << glGetString (GL_RENDERER) << std::endl;
+
+	glMatrixMode (GL_PROJECTION);
+	glLoadIdentity ();
+	gluOrtho2D (0, width, 0, height);
+	glMatrixMode (GL_MODELVIEW);
+	glLoadIdentity ();
+  	glPixelStorei (GL_PACK_ALIGNMENT, 1);
+  	glPixelStorei (GL_UNPACK_ALIGNMENT, 1);
+	glClearColor (0.0, 0.0, 0.0, 1.0);
+
+	br = new BayerRenderer ();
+	if (!(br->Initialize (width, height))) {
+		std::cerr << "ERROR: unable to initialize BayerRenderer" << std::endl;
+		return (EXIT_FAILURE);
+	}
+	br->Bind ();
+	glTexEnvf (GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+	br->SetReadback (save_frame, NULL);
+
+	// the first frame also pays for texture allocation
+	draw ();
+	glFinish ();
+	struct timeval start, end;
+	gettimeofday (&start, NULL);
+	for (int i = 0; i < frames; i++) {
+		draw ();
+	}
+	glFinish ();
+	gettimeofday (&end, NULL);
+	double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1e6;
+	printf ("FPS: %3.2f (%d frames, headless)\n", frames / elapsed, frames);
+
+	glsl = new BayerRendererGLSL ();
+	if (glsl->Initialize (width, height)) {
+		use_glsl = true;
+		draw ();
+		glFinish ();
+		gettimeofday (&start, NULL);
+		for (int i = 0; i < frames; i++) {
+			draw ();
+		}
+		glFinish ();
+		gettimeofday (&end, NULL);
+		elapsed = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1e6;
+		printf ("FPS: %3.2f (%d frames, headless, GLSL)\n", frames / elapsed, frames);
+		use_glsl = false;
+	}
+	delete glsl;
+	glsl = NULL;
+
+	compute = new BayerRendererCompute ();
+	if (compute->Initialize (width, height)) {
+		use_compute = true;
+		for (int m = 0; m < BayerRendererCompute::METHODS; m++) {
+			compute->SetMethod (static_cast<BayerRendererCompute::Method>(m));
+			draw ();
+			glFinish ();
+			gettimeofday (&start, NULL);
+			for (int i = 0; i < frames; i++) {
+				draw ();
+			}
+			glFinish ();
+			gettimeofday (&end, NULL);
+			elapsed = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1e6;
+			printf ("FPS: %3.2f (%d frames, headless, compute, %s)\n", frames / elapsed, frames,
+				m == BayerRendererCompute::METHOD_GRADIENT ? "gradient" : "bilinear");
+		}
+		use_compute = false;
+	}
+	delete compute;
+	compute = NULL;
+
+	if (br->ReadBack (0)) {
+		br->PollReadback (true);
+	} else {
+		unsigned char *p = new unsigned char[width * height * 3];
+		glReadPixels (0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, p);
+		save_frame (p, 0, NULL);
+		delete [] p;
+	}
+	delete br;
+	return (EXIT_SUCCESS);
+}
+#endif
+
 /// main function
 int
 main (int   argc,
@@ -275,9 +499,24 @@ main (int   argc,
 	char bayer_filename[MaxTextExtent];
 	int w, h;
 
+#ifdef HEADLESS
+	// -b <frames>: draw that many frames without a window, then exit
+	int frames = 0;
+	if (argc > 3 && strcmp (argv[1], "-b") == 0) {
+		frames = strtol (argv[2], NULL, 10);
+		argc -= 2;
+		argv += 2;
+	}
+#endif
 	if (argc < 2) {
+#ifdef HEADLESS
+		std::cerr << "Usage: " << argv[0] << " [-b <frames>] <bayer image filename>" << std::endl;
+		std::cerr << "Displays demosaiced Bayer pattern image, or with -b draws it" << std::endl;
+		std::cerr << "offscreen, prints the frame rate and saves the last frame." << std::endl;
+#else
 		std::cerr << "Usage: " << argv[0] << " <bayer image filename>" << std::endl;
 		std::cerr << "Displays demosaiced Bayer pattern image." << std::endl;
+#endif
 		return (EXIT_FAILURE);
 	}
 
@@ -290,6 +529,11 @@ main (int   argc,
 		std::cerr << "ERROR: unable to read image '" << bayer_filename << "'" << std::endl;
  		return (EXIT_FAILURE);
 	}
+#ifdef HEADLESS
+	if (frames > 0) {
+		return run_headless (frames);
+	}
+#endif
 
 	// init glut
  	glutInitDisplayMode (GLUT_DOUBLE | GLUT_RGBA);	
@@ -321,8 +565,24 @@ main (int   argc,
 		std::cerr << "ERROR: unable to initialize BayerRenderer" << std::endl;
 		return (EXIT_FAILURE);
 	}
+	// A partial update must leave the image a full one would
+	int diff = check_partial ();
+	if (diff > 0) {
+		std::cerr << "WARNING: partial update differs from full update by up to " << diff << std::endl;
+	}
 	br->Bind ();
 	glTexEnvf (GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+	br->SetReadback (save_frame, NULL);
+	glsl = new BayerRendererGLSL ();
+	if (!glsl->Initialize (width, height)) {
+		delete glsl;
+		glsl = NULL;
+	}
+	compute = new BayerRendererCompute ();
+	if (!compute->Initialize (width, height)) {
+		delete compute;
+		compute = NULL;
+	}
 
 	fps_counter.start ();
 	glutMainLoop ();
@@ -29,6 +29,20 @@ enum
 
 #define SCREENSHOT_FILENAME "out.tiff"
 
+// demosaicing time budget when the deadline is on, in seconds (NTSC frame period)
+static const double DEADLINE = 1.0/29.97;
+
+// names of the interpolation methods, indexed by BayerMethod
+static const char *METHOD_NAMES[] =
+{
+	"bilinear",
+	"gradient",
+	"adaptive",
+	"superpixel",
+	"edge-directed",
+	"AHD"
+};
+
 static int width = 640;
 static int height = 480;
 
@@ -38,6 +52,13 @@ static GLubyte *bayer = NULL;
 static GLUTFPSCounter fps_counter;
 static BayerRendererCPU *br;
 
+// interpolation method and whether it is scaled back to meet DEADLINE
+static BayerMethod method = BAYER_METHOD_BILINEAR;
+static bool deadline = false;
+
+// whether only tiles changed since the previous frame are demosaiced
+static bool stream = false;
+
 /// reads image file into array
 GLubyte *
 read_image (const char *filename,
@@ -179,7 +200,9 @@ display ()
 
 	// print FPS
 	if (display_fps) {
-		printf ("FPS: %3.2f\n", fps_counter.get_fps ());
+		printf ("FPS: %3.2f  method: %s%s%s\n", fps_counter.get_fps (),
+			METHOD_NAMES[br->GetMethod ()], deadline ? " (deadline)" : "",
+			stream ? " (stream)" : "");
 	}
 }
 
@@ -250,6 +273,21 @@ on_key_press (unsigned char key,
 	case 's':
 		select_from_menu (MENU_SCREENSHOT);
 		break;
+	case 'M':
+	case 'm':
+		method = static_cast<BayerMethod>((method + 1) % (sizeof (METHOD_NAMES) / sizeof (METHOD_NAMES[0])));
+		br->SetMethod (method);
+		break;
+	case 'D':
+	case 'd':
+		deadline = !deadline;
+		br->SetDeadline (deadline ? DEADLINE : 0.0);
+		break;
+	case 'I':
+	case 'i':
+		stream = !stream;
+		br->SetStream (stream);
+		break;
   	};
   	glutPostRedisplay();
 }